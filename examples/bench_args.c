@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ve_offload.h>
+
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+set_args(struct veo_args *args, int nargs, char *buf, size_t len)
+{
+  veo_args_clear(args);
+  for (int i = 0; i < nargs; ++i)
+    veo_args_set_i64(args, i, i);
+  if (len > 0)
+    veo_args_set_stack(args, VEO_INTENT_IN, nargs, buf, len);
+}
+
+static void
+wait_ok(struct veo_thr_ctxt *ctx, uint64_t req)
+{
+  uint64_t retval;
+  if (req == VEO_REQUEST_ID_INVALID ||
+      veo_call_wait_result(ctx, req, &retval) != VEO_COMMAND_OK) {
+    fprintf(stderr, "call failed\n");
+    exit(1);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int venode = argc > 1 ? atoi(argv[1]) : 0;
+  int nargs = argc > 2 ? atoi(argv[2]) : 8;
+  size_t len = argc > 3 ? atol(argv[3]) : 64;
+  int iter = argc > 4 ? atoi(argv[4]) : 100000;
+  char *buf = calloc(1, len + 1);
+  if (nargs < 1 || nargs >= VEO_MAX_NUM_ARGS) {
+    fprintf(stderr, "the number of arguments must be 1 to %d\n",
+            VEO_MAX_NUM_ARGS - 1);
+    exit(1);
+  }
+
+  /* set only, on VH */
+  struct veo_args *args = veo_args_alloc();
+  double t0 = now();
+  for (int i = 0; i < iter; ++i)
+    set_args(args, nargs, buf, len);
+  double t_set = now() - t0;
+
+  struct veo_proc_handle *proc = veo_proc_create(venode);
+  if (proc == NULL) {
+    perror("veo_proc_create");
+    exit(1);
+  }
+  uint64_t handle = veo_load_library(proc, "./libvesimplefunc.so");
+  uint64_t sym = veo_get_sym(proc, handle, "simplefunc");
+  struct veo_thr_ctxt *ctx = veo_context_open(proc);
+  if (sym == 0 || ctx == NULL) {
+    fprintf(stderr, "failed to open a context or find simplefunc\n");
+    exit(1);
+  }
+
+  /* set and call; setup of the stack image is on the context */
+  t0 = now();
+  for (int i = 0; i < iter; ++i) {
+    set_args(args, nargs, buf, len);
+    wait_ok(ctx, veo_call_async(ctx, sym, args));
+  }
+  double t_call = now() - t0;
+
+  /* prepared call with scalars only */
+  char sig[VEO_MAX_NUM_ARGS + 1] = {0};
+  for (int i = 0; i < nargs; ++i)
+    sig[i] = 'l';
+  struct veo_prepared_call *pc = veo_prepare_call(ctx, sym, sig);
+  t0 = now();
+  for (int i = 0; i < iter; ++i) {
+    for (int j = 0; j < nargs; ++j)
+      veo_prepared_set_i64(pc, j, j);
+    wait_ok(ctx, veo_prepared_launch(pc));
+  }
+  double t_prep = now() - t0;
+
+  printf("# %d scalars + %lu bytes on stack, %d iterations\n",
+         nargs, len, iter);
+  printf("set only       %10.3f us/call\n", t_set / iter * 1e6);
+  printf("set + call     %10.3f us/call\n", t_call / iter * 1e6);
+  printf("prepared call  %10.3f us/call (scalars only)\n",
+         t_prep / iter * 1e6);
+
+  veo_prepared_free(pc);
+  veo_args_free(args);
+  veo_context_close(ctx);
+  veo_proc_destroy(proc);
+  free(buf);
+  return 0;
+}
@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ve_offload.h>
+
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double
+bandwidth(struct veo_proc_handle *proc, uint64_t vebuf, char *buf,
+          size_t size, int iter)
+{
+  double t0 = now();
+  for (int i = 0; i < iter; ++i) {
+    if (veo_write_mem(proc, vebuf, buf, size) != 0 ||
+        veo_read_mem(proc, buf, vebuf, size) != 0) {
+      fprintf(stderr, "transfer failed\n");
+      exit(1);
+    }
+  }
+  double t1 = now();
+  return 2.0 * iter * size / (t1 - t0) / 1e9;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int venode = argc > 1 ? atoi(argv[1]) : 0;
+  size_t maxsize = (argc > 2 ? atol(argv[2]) : 64) << 20;
+  int iter = argc > 3 ? atoi(argv[3]) : 100;
+
+  struct veo_proc_handle *proc = veo_proc_create(venode);
+  if (proc == NULL) {
+    perror("veo_proc_create");
+    exit(1);
+  }
+  char *buf = malloc(maxsize);
+  memset(buf, 1, maxsize);
+  uint64_t vebuf;
+  if (veo_alloc_mem(proc, &vebuf, maxsize) != 0) {
+    fprintf(stderr, "veo_alloc_mem failed\n");
+    exit(1);
+  }
+
+  printf("#      size  unregistered  registered  [GB/s]\n");
+  for (size_t size = 4096; size <= maxsize; size *= 4) {
+    int n = size >= (1 << 20) ? iter / 10 + 1 : iter;
+    double bw = bandwidth(proc, vebuf, buf, size, n);
+    if (veo_register_host_mem(proc, buf, size) != 0) {
+      perror("veo_register_host_mem");
+      exit(1);
+    }
+    double bw_reg = bandwidth(proc, vebuf, buf, size, n);
+    veo_unregister_host_mem(proc, buf);
+    printf("%11lu  %12.3f  %10.3f\n", size, bw, bw_reg);
+  }
+
+  veo_free_mem(proc, vebuf);
+  free(buf);
+  veo_proc_destroy(proc);
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ve_offload.h>
+
+struct worker {
+  pthread_t thread;
+  struct veo_proc_handle *proc;
+  uint64_t vebuf;
+  char *buf;
+  size_t size;
+  int iter;
+  int failed;
+};
+
+static pthread_barrier_t barrier;
+
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *
+transfer(void *arg)
+{
+  struct worker *w = arg;
+  pthread_barrier_wait(&barrier);
+  for (int i = 0; i < w->iter; ++i) {
+    if (veo_write_mem(w->proc, w->vebuf, w->buf, w->size) != 0 ||
+        veo_read_mem(w->proc, w->buf, w->vebuf, w->size) != 0) {
+      w->failed = 1;
+      break;
+    }
+  }
+  pthread_barrier_wait(&barrier);
+  return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int venode = argc > 1 ? atoi(argv[1]) : 0;
+  size_t size = (argc > 2 ? atol(argv[2]) : 16) << 20;
+  int maxthreads = argc > 3 ? atoi(argv[3]) : 8;
+  int iter = argc > 4 ? atoi(argv[4]) : 10;
+
+  struct veo_proc_handle *proc = veo_proc_create(venode);
+  if (proc == NULL) {
+    perror("veo_proc_create");
+    exit(1);
+  }
+  struct worker *w = calloc(maxthreads, sizeof(*w));
+  for (int i = 0; i < maxthreads; ++i) {
+    w[i].proc = proc;
+    w[i].size = size;
+    w[i].iter = iter;
+    w[i].buf = malloc(size);
+    memset(w[i].buf, i, size);
+    if (veo_alloc_mem(proc, &w[i].vebuf, size) != 0) {
+      fprintf(stderr, "veo_alloc_mem failed\n");
+      exit(1);
+    }
+  }
+
+  printf("# threads  bandwidth [GB/s] (%lu MiB x %d writes and reads"
+         " per thread)\n", size >> 20, iter);
+  for (int n = 1; n <= maxthreads; n *= 2) {
+    pthread_barrier_init(&barrier, NULL, n + 1);
+    for (int i = 0; i < n; ++i)
+      pthread_create(&w[i].thread, NULL, transfer, &w[i]);
+    pthread_barrier_wait(&barrier);
+    double t0 = now();
+    pthread_barrier_wait(&barrier);
+    double t1 = now();
+    int failed = 0;
+    for (int i = 0; i < n; ++i) {
+      pthread_join(w[i].thread, NULL);
+      failed |= w[i].failed;
+    }
+    pthread_barrier_destroy(&barrier);
+    printf("%9d  %16.3f%s\n", n, 2.0 * n * iter * size / (t1 - t0) / 1e9,
+           failed ? " (failed)" : "");
+  }
+
+  for (int i = 0; i < maxthreads; ++i) {
+    veo_free_mem(proc, w[i].vebuf);
+    free(w[i].buf);
+  }
+  free(w);
+  veo_proc_destroy(proc);
+  return 0;
+}
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ve_offload.h>
+
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int venode = argc > 1 ? atoi(argv[1]) : 0;
+  int n = argc > 2 ? atoi(argv[2]) : 4;
+  const char *lib = argc > 3 ? argv[3] : "./libvehello.so";
+
+  printf("#  proc_create   load_library  context_open  context_close"
+         "  proc_destroy  [sec]\n");
+  for (int i = 0; i < n; ++i) {
+    double t0 = now();
+    struct veo_proc_handle *proc = veo_proc_create(venode);
+    if (proc == NULL) {
+      perror("veo_proc_create");
+      exit(1);
+    }
+    double t1 = now();
+    char json[1024];
+    veo_proc_dump_startup_json(proc, json, sizeof(json));
+    fprintf(stderr, "%d: %s\n", i, json);
+    uint64_t handle = veo_load_library(proc, lib);
+    if (handle == 0) {
+      fprintf(stderr, "veo_load_library(%s) failed\n", lib);
+      exit(1);
+    }
+    double t2 = now();
+    struct veo_thr_ctxt *ctx = veo_context_open(proc);
+    if (ctx == NULL) {
+      perror("veo_context_open");
+      exit(1);
+    }
+    double t3 = now();
+    veo_context_close(ctx);
+    double t4 = now();
+    veo_proc_destroy(proc);
+    double t5 = now();
+    printf("%d %12.6f %14.6f %13.6f %14.6f %13.6f\n", i,
+           t1 - t0, t2 - t1, t3 - t2, t4 - t3, t5 - t4);
+  }
+
+  /* create processes concurrently */
+  int *nodes = malloc(n * sizeof(int));
+  struct veo_proc_handle **procs = malloc(n * sizeof(*procs));
+  for (int i = 0; i < n; ++i)
+    nodes[i] = venode;
+  double t0 = now();
+  int rv = veo_proc_create_many(nodes, n, procs);
+  double t1 = now();
+  printf("veo_proc_create_many(%d): %f sec (%s)\n", n, t1 - t0,
+         rv == 0 ? "ok" : "failed");
+  for (int i = 0; i < n; ++i) {
+    if (procs[i] == NULL)
+      continue;
+    double times[VEO_STARTUP_NUM_PHASES];
+    veo_proc_get_startup_time(procs[i], times, VEO_STARTUP_NUM_PHASES);
+    printf("  %d: load_elf %f, libc_init %f, worker_clone %f\n", i,
+           times[VEO_STARTUP_LOAD_ELF], times[VEO_STARTUP_LIBC_INIT],
+           times[VEO_STARTUP_WORKER_CLONE]);
+    veo_proc_destroy(procs[i]);
+  }
+  free(procs);
+  free(nodes);
+  return rv == 0 ? 0 : 1;
+}
@@ -50,3 +50,48 @@ int test_many_inout(char *in0, int *inout1, float *out2, double d3, double d4,
 	strncpy(out8, "Hello, 89abcdef", i9 - 1);
 	return 1;
 }
+
+long test_large_args(const unsigned char *in, unsigned char *out,
+                     long *inout, long len)
+{
+	long sum = 0;
+	for (long i = 0; i < len; ++i) {
+		sum += in[i];
+		out[i] = (unsigned char)(i * 7);
+	}
+	for (long i = 0; i < len / (long)sizeof(long); ++i)
+		inout[i] += i;
+	printf("VE: %p, %p, %p, sum = %ld\n", (void *)in, (void *)out,
+	       (void *)inout, sum);
+	return sum;
+}
+
+long test_mixed_args(long l0, const unsigned char *in1, long l2,
+                     unsigned char *out3, int *small4, long l5, long l6,
+                     long l7, long *big8, long l9, double d10, long len)
+{
+	long sum = l0 + l2 + l5 + l6 + l7 + l9 + (long)d10;
+	for (long i = 0; i < len; ++i) {
+		sum += in1[i];
+		out3[i] = in1[len - 1 - i];
+	}
+	*small4 = -*small4;
+	for (long i = 0; i < len / (long)sizeof(long); ++i)
+		big8[i] *= 2;
+	printf("VE: test_mixed_args: sum = %ld\n", sum);
+	return sum;
+}
+
+long test_sparse(long a0, long a1, long a2, long a3, long a4)
+{
+	printf("VE: test_sparse: %ld, %ld, %ld, %ld, %ld\n",
+	       a0, a1, a2, a3, a4);
+	return a0 + a1 * 10 + a2 * 100 + a3 * 1000 + a4 * 10000;
+}
+
+long test_sum(const long *v, long n, long s)
+{
+	for (long i = 0; i < n; ++i)
+		s += v[i];
+	return s;
+}
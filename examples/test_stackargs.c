@@ -8,6 +8,18 @@
 #include <unistd.h>
 #include <ve_offload.h>
 
+/* larger than VEO_STACK_ARG_THRESHOLD by default; placed on VE heap */
+#define LARGE_LEN (128 * 1024)
+
+static int nfailed;
+
+static void check(const char *what, int ok)
+{
+	printf("%s: %s\n", what, ok ? "OK" : "FAILED");
+	if (!ok)
+		++nfailed;
+}
+
 int main()
 {
 	int ret;
@@ -100,7 +112,113 @@ int main()
 	printf("VH: out2 = %f (%#08x)\n", (double)out2, u.x);
 	printf("VH: out8 = %s\n", out8);
 
+	/* IN, OUT and INOUT arguments above the threshold */
+	uint64_t sym_large = veo_get_sym(proc, handle, "test_large_args");
+	printf("symbol address (test_large_args) = %p\n", (void *)sym_large);
+	unsigned char *lin = malloc(LARGE_LEN);
+	unsigned char *lout = malloc(LARGE_LEN);
+	long *linout = malloc(LARGE_LEN);
+	long nlong = LARGE_LEN / sizeof(long);
+	long expected = 0;
+	for (long i = 0; i < LARGE_LEN; ++i) {
+		lin[i] = (unsigned char)i;
+		expected += lin[i];
+	}
+	memset(lout, 0xff, LARGE_LEN);
+	for (long i = 0; i < nlong; ++i)
+		linout[i] = i;
+	arg = veo_args_alloc();
+	veo_args_set_stack(arg, VEO_INTENT_IN, 0, (char *)lin, LARGE_LEN);
+	veo_args_set_stack(arg, VEO_INTENT_OUT, 1, (char *)lout, LARGE_LEN);
+	veo_args_set_stack(arg, VEO_INTENT_INOUT, 2, (char *)linout, LARGE_LEN);
+	veo_args_set_i64(arg, 3, LARGE_LEN);
+	req = veo_call_async(ctx, sym_large, arg);
+	ret = veo_call_wait_result(ctx, req, &retval);
+	veo_args_free(arg);
+	check("large IN", ret == VEO_COMMAND_OK && retval == expected);
+	int ok = 1;
+	for (long i = 0; i < LARGE_LEN; ++i)
+		ok = ok && lout[i] == (unsigned char)(i * 7);
+	check("large OUT", ok);
+	ok = 1;
+	for (long i = 0; i < nlong; ++i)
+		ok = ok && linout[i] == 2 * i;
+	check("large INOUT", ok);
+
+	/* more than 8 arguments mixed with arguments on VE heap */
+	uint64_t sym_mixed = veo_get_sym(proc, handle, "test_mixed_args");
+	printf("symbol address (test_mixed_args) = %p\n", (void *)sym_mixed);
+	int small4 = 12345;
+	for (long i = 0; i < nlong; ++i)
+		linout[i] = i;
+	memset(lout, 0, LARGE_LEN);
+	arg = veo_args_alloc();
+	veo_args_set_i64(arg, 0, 1);
+	veo_args_set_stack(arg, VEO_INTENT_IN, 1, (char *)lin, LARGE_LEN);
+	veo_args_set_i64(arg, 2, 2);
+	veo_args_set_stack(arg, VEO_INTENT_OUT, 3, (char *)lout, LARGE_LEN);
+	veo_args_set_stack(arg, VEO_INTENT_INOUT, 4, (char *)&small4,
+	                   sizeof(small4));
+	veo_args_set_i64(arg, 5, 5);
+	veo_args_set_i64(arg, 6, 6);
+	veo_args_set_i64(arg, 7, 7);
+	veo_args_set_stack(arg, VEO_INTENT_INOUT, 8, (char *)linout, LARGE_LEN);
+	veo_args_set_i64(arg, 9, 9);
+	veo_args_set_double(arg, 10, 10.0);
+	veo_args_set_i64(arg, 11, LARGE_LEN);
+	req = veo_call_async(ctx, sym_mixed, arg);
+	ret = veo_call_wait_result(ctx, req, &retval);
+	veo_args_free(arg);
+	check("mixed scalars and IN", ret == VEO_COMMAND_OK &&
+	      retval == expected + 1 + 2 + 5 + 6 + 7 + 9 + 10);
+	ok = small4 == -12345;
+	for (long i = 0; i < LARGE_LEN; ++i)
+		ok = ok && lout[i] == lin[LARGE_LEN - 1 - i];
+	for (long i = 0; i < nlong; ++i)
+		ok = ok && linout[i] == 2 * i;
+	check("mixed OUT and INOUT", ok);
+
+	/* sparse set: arguments not set are passed as zero */
+	uint64_t sym_sparse = veo_get_sym(proc, handle, "test_sparse");
+	printf("symbol address (test_sparse) = %p\n", (void *)sym_sparse);
+	arg = veo_args_alloc();
+	veo_args_set_i64(arg, 4, 4);
+	veo_args_set_i64(arg, 1, 1);
+	req = veo_call_async(ctx, sym_sparse, arg);
+	ret = veo_call_wait_result(ctx, req, &retval);
+	check("sparse", ret == VEO_COMMAND_OK && retval == 40010);
+	/* reuse after clear does not see arguments set before */
+	veo_args_clear(arg);
+	veo_args_set_i64(arg, 2, 2);
+	veo_args_set_i64(arg, 0, 3);
+	req = veo_call_async(ctx, sym_sparse, arg);
+	ret = veo_call_wait_result(ctx, req, &retval);
+	veo_args_free(arg);
+	check("sparse after clear", ret == VEO_COMMAND_OK && retval == 203);
+
+	/* snapshot: arguments modified after submission are not seen */
+	uint64_t sym_sum = veo_get_sym(proc, handle, "test_sum");
+	printf("symbol address (test_sum) = %p\n", (void *)sym_sum);
+	for (long i = 0; i < nlong; ++i)
+		linout[i] = 1;
+	arg = veo_args_alloc();
+	veo_args_set_snapshot(arg, 1);
+	veo_args_set_stack(arg, VEO_INTENT_IN, 0, (char *)linout, LARGE_LEN);
+	veo_args_set_i64(arg, 1, nlong);
+	veo_args_set_i64(arg, 2, 100);
+	req = veo_call_async(ctx, sym_sum, arg);
+	for (long i = 0; i < nlong; ++i)
+		linout[i] = 2;
+	veo_args_set_i64(arg, 2, 200);
+	ret = veo_call_wait_result(ctx, req, &retval);
+	check("snapshot", ret == VEO_COMMAND_OK && retval == nlong + 100);
+	veo_args_free(arg);
+	free(lin);
+	free(lout);
+	free(linout);
+
 	veo_context_close(ctx);
-	return 0;
+	printf("%d checks failed\n", nfailed);
+	return nfailed == 0 ? 0 : 1;
 }
 
@@ -33,6 +33,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -58,8 +59,95 @@ enum veo_args_intent {
   VEO_INTENT_OUT,
 };
 
+enum veo_startup_phase {
+  VEO_STARTUP_OS_HANDLE = 0,
+  VEO_STARTUP_SHM,
+  VEO_STARTUP_NEW_PROC,
+  VEO_STARTUP_LOAD_ELF,
+  VEO_STARTUP_INIT_STACK,
+  VEO_STARTUP_START_PROC,
+  VEO_STARTUP_LIBC_INIT,
+  VEO_STARTUP_HELPER_FETCH,
+  VEO_STARTUP_WORKER_CLONE,
+  VEO_STARTUP_PRELOAD,
+  VEO_STARTUP_NUM_PHASES,
+};
+
+/**
+ * @brief statistics of a context owned by the dispatcher of a process
+ */
+struct veo_dispatch_stats {
+  struct veo_thr_ctxt *ctx;
+  uint64_t executed;/*!< the number of calls executed */
+  uint64_t stolen;/*!< the number of calls stolen from other contexts */
+  uint64_t queued;/*!< the number of calls waiting on the context */
+  double busy;/*!< time executing calls in seconds */
+  double utilization;/*!< ratio of busy time since the context is added */
+};
+
+/**
+ * @brief parameters of elastic scaling of contexts of the dispatcher
+ */
+struct veo_dispatch_scaling {
+  int min_contexts;/*!< the number of contexts kept open */
+  int max_contexts;/*!< the maximum number of contexts */
+  int queue_depth;/*!< open a context if calls queued per context exceed */
+  double wait_time;/*!< open a context if a call waits longer (sec) */
+  double idle_time;/*!< close a context idle longer (sec) */
+  double interval;/*!< interval of checking the load (sec) */
+};
+
+/**
+ * @brief host buffer indexed by the range of veo_parallel_for()
+ */
+struct veo_pfor_buf {
+  void *host;/*!< buffer on VH for the whole range, from its begin */
+  size_t elem_size;/*!< size of data for an index in byte */
+  enum veo_args_intent intent;/*!< IN: uploaded, OUT: downloaded */
+};
+
+/**
+ * @brief an element of an I/O vector on VE
+ */
+struct veo_iovec {
+  uint64_t addr;/*!< VEMVA */
+  size_t len;/*!< length in byte */
+};
+
+/**
+ * @brief usage of the VE memory arena of a process
+ */
+struct veo_mem_stats {
+  uint64_t regions;/*!< the number of regions allocated on VE */
+  uint64_t region_bytes;/*!< bytes of regions */
+  uint64_t slab_bytes;/*!< bytes of regions split into blocks */
+  uint64_t used_bytes;/*!< bytes of blocks allocated */
+  uint64_t large_blocks;/*!< the number of blocks larger than 256 KiB */
+  uint64_t large_bytes;/*!< bytes of blocks larger than 256 KiB */
+  double fragmentation;/*!< ratio of bytes not allocated in slab_bytes */
+};
+
+/**
+ * @brief statistics of a streaming pipeline run by veo_stream_run()
+ */
+struct veo_stream_stats {
+  uint64_t chunks;/*!< the number of buffers processed */
+  uint64_t bytes_in;/*!< bytes uploaded */
+  uint64_t bytes_out;/*!< bytes downloaded */
+  double elapsed;/*!< elapsed time in seconds */
+  double write_time;/*!< time uploading in seconds */
+  double call_time;/*!< time in the VE function in seconds */
+  double read_time;/*!< time downloading in seconds */
+  double overlap;/*!< sum of the times of the stages over elapsed time */
+  double throughput;/*!< bytes uploaded per second */
+};
+
 struct veo_args;
+struct veo_ctxt_group;
+struct veo_proc_future;
 struct veo_proc_handle;
+struct veo_prepared_call;
+struct veo_proc_pool;
 struct veo_thr_ctxt;
 
 struct veo_proc_handle *veo_proc_create(int);
@@ -67,13 +155,39 @@ struct veo_proc_handle *veo_proc_create_static(int, const char *);
 int veo_proc_destroy(struct veo_proc_handle *);
 struct veo_proc_handle *veo_proc__create(const char *, const char *,
                                          const char *);
+struct veo_proc_future *veo_proc_create_async(int);
+struct veo_proc_handle *veo_proc_future_wait(struct veo_proc_future *);
+int veo_proc_create_many(const int *, int, struct veo_proc_handle **);
+int veo_proc_get_startup_time(struct veo_proc_handle *, double *, int);
+int veo_proc_dump_startup_json(struct veo_proc_handle *, char *, size_t);
+struct veo_proc_pool *veo_proc_pool_create(int, int, const char *);
+struct veo_proc_handle *veo_proc_pool_acquire(struct veo_proc_pool *);
+int veo_proc_pool_release(struct veo_proc_pool *, struct veo_proc_handle *);
+int veo_proc_pool_destroy(struct veo_proc_pool *);
 uint64_t veo_load_library(struct veo_proc_handle *, const char *);
 uint64_t veo_get_sym(struct veo_proc_handle *, uint64_t, const char *);
 
 struct veo_thr_ctxt *veo_context_open(struct veo_proc_handle *);
+int veo_context_open_many(struct veo_proc_handle *, int,
+                          struct veo_thr_ctxt **);
 int veo_context_close(struct veo_thr_ctxt *);
+int veo_context_open_transfer_lane(struct veo_thr_ctxt *);
 int veo_get_context_state(struct veo_thr_ctxt *);
 
+/**
+ * @brief callback to set arguments of a call on a context group
+ *
+ * Called with arguments, the rank and the size of the group;
+ * returns zero upon success.
+ */
+typedef int (*veo_args_builder)(struct veo_args *, int, int, void *);
+
+struct veo_ctxt_group *veo_ctxt_group_open(struct veo_proc_handle *, int);
+struct veo_ctxt_group *veo_ctxt_group_create(struct veo_thr_ctxt **, int);
+int veo_ctxt_group_size(struct veo_ctxt_group *);
+struct veo_thr_ctxt *veo_ctxt_group_get(struct veo_ctxt_group *, int);
+int veo_ctxt_group_close(struct veo_ctxt_group *);
+
 struct veo_args *veo_args_alloc(void);
 int veo_args_set_i64(struct veo_args *, int, int64_t);
 int veo_args_set_u64(struct veo_args *, int, uint64_t);
@@ -83,20 +197,91 @@ int veo_args_set_double(struct veo_args *, int, double);
 int veo_args_set_float(struct veo_args *, int, float);
 int veo_args_set_stack(struct veo_args *, enum veo_args_intent,
                        int, char *, size_t);
+int veo_args_set_snapshot(struct veo_args *, int);
 void veo_args_clear(struct veo_args *);
 void veo_args_free(struct veo_args *);
 
 uint64_t veo_call_async(struct veo_thr_ctxt *, uint64_t, struct veo_args *);
+uint64_t veo_call_async_dep(struct veo_thr_ctxt *, uint64_t, struct veo_args *,
+                            const uint64_t *, int);
 uint64_t veo_call_async_by_name(struct veo_thr_ctxt *, uint64_t, const char *, struct veo_args *);
+struct veo_prepared_call *veo_prepare_call(struct veo_thr_ctxt *, uint64_t,
+                                           const char *);
+int veo_prepared_set_i64(struct veo_prepared_call *, int, int64_t);
+int veo_prepared_set_u64(struct veo_prepared_call *, int, uint64_t);
+int veo_prepared_set_i32(struct veo_prepared_call *, int, int32_t);
+int veo_prepared_set_u32(struct veo_prepared_call *, int, uint32_t);
+int veo_prepared_set_double(struct veo_prepared_call *, int, double);
+int veo_prepared_set_float(struct veo_prepared_call *, int, float);
+uint64_t veo_prepared_launch(struct veo_prepared_call *);
+void veo_prepared_free(struct veo_prepared_call *);
 int veo_call_peek_result(struct veo_thr_ctxt *, uint64_t, uint64_t *);
 int veo_call_wait_result(struct veo_thr_ctxt *, uint64_t, uint64_t *);
+uint64_t veo_call_all(struct veo_ctxt_group *, uint64_t, veo_args_builder,
+                      void *);
+int veo_call_all_peek_result(struct veo_ctxt_group *, uint64_t, uint64_t *);
+int veo_call_all_wait_result(struct veo_ctxt_group *, uint64_t, uint64_t *);
+int veo_parallel_for(struct veo_ctxt_group *, uint64_t, size_t, size_t,
+                     size_t, const struct veo_pfor_buf *, int);
+
+/**
+ * @brief callback to fill an input buffer of a stream
+ *
+ * Called with the buffer, its size and user data; returns the number of
+ * bytes filled, or zero at the end of the stream.
+ */
+typedef size_t (*veo_stream_source)(void *, size_t, void *);
+/**
+ * @brief callback to consume an output buffer of a stream
+ *
+ * Called with the buffer, the size of the output and user data;
+ * returns zero upon success.
+ */
+typedef int (*veo_stream_sink)(const void *, size_t, void *);
+
+int veo_stream_run(struct veo_thr_ctxt *, uint64_t, size_t, size_t, int,
+                   veo_stream_source, veo_stream_sink, void *,
+                   struct veo_stream_stats *);
+int veo_proc_dispatch_open(struct veo_proc_handle *, int);
+/*
+ * Request IDs of veo_proc_call_async*() are issued by the dispatcher, not
+ * by a context; wait for them by veo_proc_call_{wait,peek}_result() only.
+ */
+uint64_t veo_proc_call_async(struct veo_proc_handle *, uint64_t,
+                             struct veo_args *);
+uint64_t veo_proc_call_async_by_name(struct veo_proc_handle *, uint64_t,
+                                     const char *, struct veo_args *);
+int veo_proc_call_peek_result(struct veo_proc_handle *, uint64_t, uint64_t *);
+int veo_proc_call_wait_result(struct veo_proc_handle *, uint64_t, uint64_t *);
+int veo_proc_dispatch_get_stats(struct veo_proc_handle *,
+                                struct veo_dispatch_stats *, int);
+int veo_proc_dispatch_set_scaling(struct veo_proc_handle *,
+                                  const struct veo_dispatch_scaling *);
 int veo_alloc_mem(struct veo_proc_handle *, uint64_t *, const size_t);
 int veo_free_mem(struct veo_proc_handle *, uint64_t);
+int veo_proc_get_mem_stats(struct veo_proc_handle *, struct veo_mem_stats *);
 int veo_read_mem(struct veo_proc_handle *, void *, uint64_t, size_t);
 int veo_write_mem(struct veo_proc_handle *, uint64_t, const void *, size_t);
+int veo_proc_set_transfer_striping(struct veo_proc_handle *, size_t, int);
+int veo_write_mem_iov(struct veo_proc_handle *, const struct iovec *, int,
+                      const struct veo_iovec *, int);
+int veo_read_mem_iov(struct veo_proc_handle *, const struct iovec *, int,
+                     const struct veo_iovec *, int);
+int veo_write_mem_2d(struct veo_proc_handle *, uint64_t, size_t, const void *,
+                     size_t, size_t, size_t);
+int veo_read_mem_2d(struct veo_proc_handle *, void *, size_t, uint64_t, size_t,
+                    size_t, size_t);
+int veo_register_host_mem(struct veo_proc_handle *, void *, size_t);
+int veo_unregister_host_mem(struct veo_proc_handle *, void *);
 uint64_t veo_async_read_mem(struct veo_thr_ctxt *, void *, uint64_t, size_t);
 uint64_t veo_async_write_mem(struct veo_thr_ctxt *, uint64_t, const void *,
                              size_t);
+uint64_t veo_alloc_mem_async(struct veo_thr_ctxt *, size_t, uint64_t *);
+uint64_t veo_free_mem_async(struct veo_thr_ctxt *, uint64_t);
+uint64_t veo_async_read_mem_dep(struct veo_thr_ctxt *, void *, uint64_t,
+                                size_t, const uint64_t *, int);
+uint64_t veo_async_write_mem_dep(struct veo_thr_ctxt *, uint64_t,
+                                 const void *, size_t, const uint64_t *, int);
 
 const char *veo_version_string(void);
 const int veo_api_version(void);
@@ -5,6 +5,7 @@
 #include "ProcHandle.hpp"
 #include "ThreadContext.hpp"
 #include "CommandImpl.hpp"
+#include "VEOException.hpp"
 
 namespace veo {
 /**
@@ -13,32 +14,199 @@ namespace veo {
  * @param[out] dst buffer to store data
  * @param src VEMVA to read
  * @param size size to transfer in byte
+ * @param deps requests on this context to finish before the transfer
  * @return request ID
+ *
+ * The transfer is served by the transfer lane if opened.
  */
-uint64_t ThreadContext::asyncReadMem(void *dst, uint64_t src, size_t size)
+uint64_t ThreadContext::asyncReadMem(void *dst, uint64_t src, size_t size,
+                                     const std::vector<uint64_t> &deps)
 {
   auto id = this->issueRequestID();
-  auto f = [this, dst, src, size] (Command *cmd) {
-    auto rv = this->_readMem(dst, src, size);
+  // the lane is not closed until the request is pushed.
+  std::lock_guard<std::mutex> lock(this->lane_mtx);
+  auto lane = this->lane.get();
+  auto f = [this, lane, dst, src, size, deps] (Command *cmd) {
+    this->waitRequests(deps);
+    auto rv = lane != nullptr ? lane->readMem(dst, src, size)
+                              : this->_readMem(dst, src, size);
     cmd->setResult(rv, rv == 0 ? VEO_COMMAND_OK : VEO_COMMAND_ERROR);
     return rv;
   };
   std::unique_ptr<Command> req(new internal::CommandImpl(id, f));
-  this->comq.pushRequest(std::move(req));
+  if (lane != nullptr) {
+    {
+      std::lock_guard<std::mutex> req_lock(this->req_mtx);
+      this->lane_reqs.insert(id);
+    }
+    lane->push(std::move(req));
+  } else {
+    this->comq.pushRequest(std::move(req));
+  }
   return id;
 }
 
 uint64_t ThreadContext::asyncWriteMem(uint64_t dst, const void *src,
-                                      size_t size)
+                                      size_t size,
+                                      const std::vector<uint64_t> &deps)
 {
   auto id = this->issueRequestID();
-  auto f = [this, dst, src, size] (Command *cmd) {
-    auto rv = this->_writeMem(dst, src, size);
+  // the lane is not closed until the request is pushed.
+  std::lock_guard<std::mutex> lock(this->lane_mtx);
+  auto lane = this->lane.get();
+  auto f = [this, lane, dst, src, size, deps] (Command *cmd) {
+    this->waitRequests(deps);
+    auto rv = lane != nullptr ? lane->writeMem(dst, src, size)
+                              : this->_writeMem(dst, src, size);
     cmd->setResult(rv, rv == 0 ? VEO_COMMAND_OK : VEO_COMMAND_ERROR);
     return rv;
   };
   std::unique_ptr<Command> req(new internal::CommandImpl(id, f));
+  if (lane != nullptr) {
+    {
+      std::lock_guard<std::mutex> req_lock(this->req_mtx);
+      this->lane_reqs.insert(id);
+    }
+    lane->push(std::move(req));
+  } else {
+    this->comq.pushRequest(std::move(req));
+  }
+  return id;
+}
+
+/**
+ * @brief asynchronously allocate VE memory
+ *
+ * @param size size in byte
+ * @param[out] slot VEMVA of the memory allocated
+ * @return request ID; the result of the request is the VEMVA.
+ *
+ * With the VE memory arena, the memory is allocated on VH and the slot is
+ * set before return, so that transfers and calls using the memory can be
+ * requested without waiting. Otherwise, the memory is allocated and the
+ * slot is set in order with other requests on this context.
+ */
+uint64_t ThreadContext::asyncAllocMem(size_t size, uint64_t *slot)
+{
+  auto proc = this->proc;
+  bool eager = proc->hasArena();
+  uint64_t addr = 0;
+  if (eager) {
+    addr = proc->allocBuff(size);
+    *slot = addr;
+  }
+  auto id = this->issueRequestID();
+  auto f = [proc, eager, addr, size, slot] (Command *cmd) {
+    auto a = addr;
+    if (!eager) {
+      try {
+        a = proc->allocBuff(size);
+      } catch (VEOException &e) {
+        a = 0;
+      }
+      *slot = a;
+    }
+    cmd->setResult(a, a != 0 ? VEO_COMMAND_OK : VEO_COMMAND_ERROR);
+    return 0;
+  };
+  std::unique_ptr<Command> req(new internal::CommandImpl(id, f));
+  this->comq.pushRequest(std::move(req));
+  return id;
+}
+
+/**
+ * @brief asynchronously free VE memory
+ *
+ * @param addr VEMVA of the memory
+ * @return request ID
+ *
+ * The memory is freed after requests on this context before, including
+ * transfers on the transfer lane.
+ */
+uint64_t ThreadContext::asyncFreeMem(uint64_t addr)
+{
+  auto id = this->issueRequestID();
+  std::vector<uint64_t> deps;
+  {
+    std::lock_guard<std::mutex> lock(this->req_mtx);
+    deps.assign(this->lane_reqs.begin(), this->lane_reqs.end());
+  }
+  auto proc = this->proc;
+  auto f = [this, proc, addr, deps] (Command *cmd) {
+    this->waitRequests(deps);
+    try {
+      proc->freeBuff(addr);
+      cmd->setResult(0, VEO_COMMAND_OK);
+    } catch (VEOException &e) {
+      cmd->setResult(e.err(), VEO_COMMAND_ERROR);
+    }
+    return 0;
+  };
+  std::unique_ptr<Command> req(new internal::CommandImpl(id, f));
   this->comq.pushRequest(std::move(req));
   return id;
 }
+
+/**
+ * @brief open a transfer lane for this context
+ *
+ * Transfers requested after the lane is opened run concurrently with
+ * calls on this context. On failure, transfers are kept served by the
+ * pseudo thread of this context.
+ */
+void ThreadContext::openTransferLane()
+{
+  std::lock_guard<std::mutex> lock(this->lane_mtx);
+  if (this->lane != nullptr)
+    return;
+  this->lane.reset(new TransferLane(this, this->os_handle));
+}
+
+/**
+ * @brief close the transfer lane of this context
+ *
+ * Transfers already pushed to the lane are finished before return;
+ * transfers requested later are served by the pseudo thread.
+ */
+void ThreadContext::closeTransferLane()
+{
+  std::unique_ptr<TransferLane> l;
+  {
+    std::lock_guard<std::mutex> lock(this->lane_mtx);
+    l = std::move(this->lane);
+  }
+}
+
+/**
+ * @brief mark a request finished
+ *
+ * @param id request ID
+ */
+void ThreadContext::finishRequest(uint64_t id)
+{
+  std::lock_guard<std::mutex> lock(this->req_mtx);
+  this->inflight.erase(id);
+  this->lane_reqs.erase(id);
+  this->finish_cond.notify_all();
+}
+
+/**
+ * @brief wait for requests to finish
+ *
+ * @param deps request IDs; an ID not issued on this context is regarded
+ *        as finished.
+ *
+ * Dependencies are to be issued before the request waiting for them so
+ * that the pseudo thread and the transfer lane never wait for each other.
+ */
+void ThreadContext::waitRequests(const std::vector<uint64_t> &deps)
+{
+  if (deps.empty())
+    return;
+  std::unique_lock<std::mutex> lock(this->req_mtx);
+  for (auto id: deps) {
+    while (this->inflight.find(id) != this->inflight.end())
+      this->finish_cond.wait(lock);
+  }
+}
 } // namespace veo
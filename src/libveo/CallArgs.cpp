@@ -5,9 +5,12 @@
 
 #include "log.hpp"
 #include "CallArgs.hpp"
+#include "ThreadContext.hpp"
+#include <algorithm>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
-#include <numeric>
 #include <string>
 
 namespace veo{
@@ -30,163 +33,31 @@ namespace internal {
  * -------------------
  * ******************* */
 
-template<typename T> void set_value(std::string &str, size_t offset, T value)
+} // namespace internal
+
+/**
+ * @brief the slot of an argument
+ * @param argnum argument number
+ * @return reference to the slot; slots skipped are cleared.
+ */
+internal::ArgSlot &CallArgs::slot(int argnum)
 {
-  // assume little endian
-  static_assert(std::is_fundamental<T>::value, "T must be fundamental");
-  union {
-    T value_;
-    char image_[sizeof(T)];
-  } data;
-  data.value_ = value;
-  // extend if necessary
-  if (str.size() < offset) {
-    str.resize(offset);
+  if (argnum < 0 || argnum >= VEO_MAX_NUM_ARGS) {
+    throw VEOException("argument number out of range", EINVAL);
   }
-  // put
-  str.replace(offset, sizeof(T), data.image_, sizeof(T));
-  // pad for 8 byte-aligned
-  if (sizeof(T) % 8 > 0) {
-    auto padsize = 8 - (sizeof(T) % 8);
-    str.replace(offset + sizeof(T), padsize, padsize, '\0');
+  for (; this->num_args <= argnum; ++this->num_args) {
+    this->slots[this->num_args].kind = internal::ArgSlot::NONE;
+    this->slots[this->num_args].value = 0;
   }
+  return this->slots[argnum];
 }
 
-//XXX: long double and _Complex are not supported.
-template<typename T> class ArgType: public ArgBase {
-  static_assert(std::is_fundamental<T>::value, "not fundamental type.");
-  static_assert(std::is_integral<T>::value || std::is_same<T, double>::value,
-    "integer or double are supported");
-  static_assert(!std::is_same<T, float>::value,
-    "float requires specialization due to ABI");
-  T value_;
-public:
-  explicit ArgType(const T arg): value_(arg) {}
-
-  /**
-   * @brief a value on register
-   * @param sp stack pointer
-   * @param n_args the number of arguments
-   * @param used_size the size of stack used
-   * @return a value to be set to on a register
-   */
-  int64_t getRegVal(uint64_t sp, int n_args, size_t &used_size) const {
-    return *reinterpret_cast<const int64_t *>(&this->value_);
-  }
-
-  void setStackImage(uint64_t sp, std::string &stack, int n,
-                     bool &in, bool &out) {
-    VEO_TRACE(nullptr, "%s(%#lx, _, %d)", __func__, sp, n);
-    out = false;
-    in = false;
-    if (n < NUM_ARGS_ON_REGISTER)
-      return;// do nothing
-    in = true;
-    static_assert(std::is_fundamental<T>::value && sizeof(T) <= 8,
-      "template parameter T must be fundamental");
-    auto pos = PARAM_AREA_OFFSET + n * 8;
-    set_value(stack, pos, this->value_);
-  }
-
-  size_t sizeOnStack() const { return 0;}
-  void copyoutFromStackImage(uint64_t sp, const char *img){}// nothing
-};
-
-template<> class ArgType<float>: public ArgBase {
-  union u {
-    float f_[2];
-    int64_t i64_;
-    u(float f): f_{0.0, f} {}
-  } u_;
-public:
-  explicit ArgType(const float f): u_(f) {}
-  int64_t getRegVal(uint64_t sp, int n_args, size_t &used_size) const {
-    return this->u_.i64_;
-  }
-  void setStackImage(uint64_t sp, std::string &stack, int n,
-                     bool &in, bool &out) {
-    VEO_TRACE(nullptr, "%s(%#lx, _, %d)", __func__, sp, n);
-    out = false;
-    in = false;
-    if (n < NUM_ARGS_ON_REGISTER)
-      return;// do nothing
-    in = true;
-    auto pos = PARAM_AREA_OFFSET + n * 8;
-    set_value(stack, pos, this->u_.i64_);
-  }
-
-  size_t sizeOnStack() const { return 0;}
-  void copyoutFromStackImage(uint64_t sp, const char *img){}// nothing
-};
-
-class ArgOnStack: public ArgBase {
-  char *buff_;
-  size_t len_;
-  bool in_;// copy in from VH memory to VE stack
-  bool out_;// copy out to VH memory from VE stack
-  uint64_t vemva_;
-public:
-  ArgOnStack(char *buff, size_t len, bool in, bool out): buff_(buff),
-    len_(len), in_(in), out_(out) {}
-
-  /**
-   * @brief a value on register
-   * @param sp stack pointer
-   * @param n_args the number of arguments
-   * @param used_size the size of stack used
-   * @return a value to be set to on a register
-   */
-  int64_t getRegVal(uint64_t sp, int n_args, size_t &used_size) const {
-    return this->vemva_;
-  }
-
-  void setStackImage(uint64_t sp, std::string &stack, int n,
-                     bool &in, bool &out) {
-    VEO_TRACE(nullptr, "%s(%#lx, _, %d)", __func__, sp, n);
-    auto oldlen = stack.size();
-    this->vemva_ = sp + oldlen;
-    in = this->in_;
-    out = this->out_;
-    if (this->in_) {
-      stack.append(this->buff_, this->len_);
-    } else {
-      stack.append(this->len_, '\0');
-    }
-    // padding for 8 byte-aligned
-    if (this->len_ % 8 > 0) {
-      auto n_pad = 8 - (this->len_ % 8);
-      stack.append(n_pad, '\0');
-    }
-    // point the image
-    if (n >= NUM_ARGS_ON_REGISTER) {
-      set_value(stack, PARAM_AREA_OFFSET + 8 * n, this->vemva_);
-    }
-  }
-
-  size_t sizeOnStack() const {
-    size_t rv = this->len_;
-    if (this->len_ % 8 > 0) {
-      rv += 8 - (this->len_ % 8);
-    }
-    return rv;
-  }
-  void copyoutFromStackImage(uint64_t sp, const char *img) {
-    VEO_TRACE(nullptr, "%s(%#012lx, ...)", __func__, sp);
-    if (!this->out_)
-      return;
-    VEO_DEBUG(nullptr, "copy out to VH: offset %#lx -> %p, size = %d",
-      this->vemva_ - sp, this->buff_, this->len_);
-    std::memcpy(this->buff_, img + (this->vemva_ - sp), this->len_);
-  }
-};
-} // namespace internal
-
 /**
  * @brief push, add at the last, an argument
  * @param val argument value
  */
 template <typename T> void CallArgs::push_(T val) {
-  this->arguments.push_back(std::unique_ptr<internal::ArgBase>(new internal::ArgType<T>(val)));
+  this->set_(this->num_args, val);
 }
 
 /**
@@ -195,11 +66,9 @@ template <typename T> void CallArgs::push_(T val) {
  * @param val argument value
  */
 template <typename T> void CallArgs::set_(int argnum, T val) {
-  if (this->arguments.size() < argnum + 1) {
-    //extend
-    this->arguments.resize(argnum + 1);
-  }
-  this->arguments[argnum] = std::unique_ptr<internal::ArgBase>(new internal::ArgType<T>(val));
+  auto &a = this->slot(argnum);
+  a.kind = internal::ArgSlot::VALUE;
+  a.value = internal::reg_value(val);
 }
 
 // force instantiation
@@ -220,97 +89,230 @@ template void CallArgs::set_<float>(int, float);
  */
 void CallArgs::setOnStack(enum veo_args_intent inout, int argnum,
                                char *buff, size_t len) {
-  bool copiedin = (inout == VEO_INTENT_IN || inout == VEO_INTENT_INOUT);
-  bool copiedout = (inout == VEO_INTENT_OUT || inout == VEO_INTENT_INOUT);
-  if (this->arguments.size() < argnum + 1) {
-    //extend
-    this->arguments.resize(argnum + 1);
-  }
-  this->arguments[argnum] = std::unique_ptr<internal::ArgBase>(new internal::ArgOnStack(buff, len, copiedin, copiedout));
+  auto &a = this->slot(argnum);
+  a.kind = internal::ArgSlot::STACK;
+  a.in = (inout == VEO_INTENT_IN || inout == VEO_INTENT_INOUT);
+  a.out = (inout == VEO_INTENT_OUT || inout == VEO_INTENT_INOUT);
+  a.on_heap = false;
+  a.value = 0;
+  a.buff = buff;
+  a.src = buff;
+  a.len = len;
 }
 
 /**
- * @brief get a value on register
- * @param sp stack pointer
- * @return registar arguments
+ * @brief get values on registers
+ * @param[out] regs values of arguments on registers,
+ *             NUM_ARGS_ON_REGISTER at most
+ * @return the number of values
+ *
+ * VEMVA of arguments on stack are determined in setup().
  */
-std::vector<uint64_t> CallArgs::getRegVal(uint64_t sp) const {
-  size_t stack_consumed = 0;
-  std::vector<uint64_t> rv;
-  int count = 0;
-  for (auto &arg: this->arguments) {
-    rv.push_back(arg->getRegVal(sp, this->numArgs(), stack_consumed));
-    if (++count >= NUM_ARGS_ON_REGISTER)
-      break;
+int CallArgs::getRegVal(uint64_t *regs) const {
+  auto n = std::min(this->num_args, NUM_ARGS_ON_REGISTER);
+  for (int i = 0; i < n; ++i)
+    regs[i] = this->slots[i].value;
+  return n;
+}
+
+/**
+ * @brief take a snapshot of arguments for a call
+ * @return a copy of the arguments holding the data copied in;
+ *         nullptr unless snapshot mode is enabled.
+ *
+ * The arguments can be modified or freed as soon as a call is submitted
+ * with the snapshot. Arguments with VEO_INTENT_OUT or VEO_INTENT_INOUT
+ * are still copied out to the buffers set.
+ */
+std::shared_ptr<CallArgs> CallArgs::snapshot() const
+{
+  if (!this->snapshot_mode)
+    return nullptr;
+  std::shared_ptr<CallArgs> rv(new CallArgs());
+  rv->num_args = this->num_args;
+  std::copy(this->slots, this->slots + this->num_args, rv->slots);
+  size_t size = 0;
+  for (int n = 0; n < this->num_args; ++n) {
+    auto &a = this->slots[n];
+    if (a.kind == internal::ArgSlot::STACK && a.in)
+      size += a.len;
+  }
+  rv->data.resize(size);
+  size_t pos = 0;
+  for (int n = 0; n < rv->num_args; ++n) {
+    auto &a = rv->slots[n];
+    if (a.kind != internal::ArgSlot::STACK || !a.in)
+      continue;
+    std::memcpy(rv->data.data() + pos, a.src, a.len);
+    a.src = rv->data.data() + pos;
+    pos += a.len;
   }
   return rv;
 }
 
 /**
- * @brief get the stack image
+ * @brief get a buffer of a size at least
+ * @param size size in byte
+ * @return buffer aligned for transfer; valid until the next call.
+ */
+char *StackBuffer::get(size_t size)
+{
+  if (size > this->capacity) {
+    constexpr size_t alignment = 64;
+    void *p;
+    auto capacity = std::max(size, 2 * this->capacity);
+    if (posix_memalign(&p, alignment, capacity) != 0) {
+      throw VEOException("failed to allocate stack image buffer", ENOMEM);
+    }
+    free(this->buf);
+    this->buf = static_cast<char *>(p);
+    this->capacity = capacity;
+  }
+  return this->buf;
+}
+
+StackBuffer::~StackBuffer()
+{
+  free(this->buf);
+}
+
+namespace internal {
+/**
+ * @brief the maximum size of an argument placed on VE stack
+ *
+ * Larger arguments are placed on VE heap; specified by
+ * VEO_STACK_ARG_THRESHOLD.
+ */
+size_t stack_arg_threshold()
+{
+  static const size_t threshold = [] {
+    const char *env = getenv("VEO_STACK_ARG_THRESHOLD");
+    return env != nullptr ? strtoul(env, nullptr, 0) : 64UL << 10;
+  }();
+  return threshold;
+}
+} // namespace internal
+
+/**
+ * @brief build the stack image
  * @param[in,out] sp reference to stack pointer
- * @return stack image
+ * @param buf buffer of the context to hold the stack image
+ * @param heap context of which VE heap buffer holds large arguments;
+ *        nullptr to place all arguments on stack.
+ *
+ * The image is built directly in the buffer, which is used until
+ * copyout(). Arguments on stack larger than the threshold are placed in
+ * the VE heap buffer instead, so that a large argument never overflows
+ * VE stack and is transferred only in its direction.
  */
-std::string CallArgs::getStackImage(uint64_t &sp) {
-  VEO_TRACE(nullptr, "getStackImage(%#lx)", sp);
-  // allocate stack
-  size_t stack_size = PARAM_AREA_OFFSET + 8 * this->numArgs()
-    + std::accumulate(this->arguments.begin(), this->arguments.end(), 0,
-        [](size_t s, decltype(this->arguments)::reference arg) {
-          return s + arg->sizeOnStack();
-        });
+void CallArgs::setup(uint64_t &sp, StackBuffer &buf, ThreadContext *heap)
+{
+  VEO_TRACE(nullptr, "setup CallArgs (sp = %#lx)...", sp);
+  auto threshold = heap ? internal::stack_arg_threshold() : SIZE_MAX;
+  auto end = this->slots + this->num_args;
+  size_t heap_size = 0;
+  for (auto a = this->slots; a != end; ++a)
+    heap_size += a->sizeOnHeap(threshold);
+  uint64_t heap_addr = 0;
+  if (heap_size > 0) {
+    heap_addr = heap->heapBuffer(heap_size);
+    VEO_TRACE(nullptr, "%lu bytes on heap at %#lx", heap_size, heap_addr);
+    if (heap_addr == 0)
+      threshold = SIZE_MAX;// no VE heap buffer; place all on stack.
+  }
+  // place arguments on heap and allocate stack
+  size_t param_size = PARAM_AREA_OFFSET + 8 * this->num_args;
+  size_t stack_size = param_size;
+  for (auto a = this->slots; a != end; ++a) {
+    if (a->kind != internal::ArgSlot::STACK)
+      continue;
+    auto size = a->sizeOnHeap(threshold);
+    a->on_heap = (size > 0);
+    if (a->on_heap) {
+      a->value = heap_addr;
+      heap_addr += size;
+    }
+    stack_size += a->sizeOnStack();
+  }
   VEO_TRACE(nullptr, "stack size = %lu", stack_size);
   this->stack_size = stack_size;
   sp -= stack_size;// shift stack pointer
   this->stack_top = sp;
-  std::string stack(PARAM_AREA_OFFSET + 8 * this->numArgs(), '\0');
+  this->stack_image = buf.get(stack_size);
+  auto image = this->stack_image;
+  std::memset(image, 0, param_size);
 
-  int n = 0;
-  this->copied_in = false;
-  this->copied_out = false;
-  for (const auto &arg: this->arguments) {
-    bool i, o;
-    arg->setStackImage(sp, stack, n++, i, o);
-    this->copied_in = this->copied_in || i;
-    this->copied_out = this->copied_out || o;
+  size_t pos = param_size;
+  bool in = false, out = false;
+  for (int n = 0; n < this->num_args; ++n) {
+    auto &a = this->slots[n];
+    if (a.kind == internal::ArgSlot::STACK) {
+      out = out || a.out;
+      if (!a.on_heap) {
+        // put the data into the stack image
+        a.value = sp + pos;
+        in = in || a.in;
+        if (a.in) {
+          std::memcpy(image + pos, a.src, a.len);
+        } else {
+          std::memset(image + pos, 0, a.len);
+        }
+        // padding for 8 byte-aligned
+        std::memset(image + pos + a.len, 0, a.sizeOnStack() - a.len);
+        pos += a.sizeOnStack();
+      }
+    }
+    if (n >= NUM_ARGS_ON_REGISTER) {
+      std::memcpy(image + PARAM_AREA_OFFSET + 8 * n, &a.value, 8);
+      in = true;
+    }
   }
-  return stack;
-}
-
-void CallArgs::setup(uint64_t &sp)
-{
-  VEO_TRACE(nullptr, "setup CallArgs (sp = %#lx)...", sp);
-  auto img = this->getStackImage(sp);
-  VEO_ASSERT(this->stack_size == img.size());
-  auto buf = new char[this->stack_size];
-  memcpy(buf, img.c_str(), this->stack_size);
-  this->stack_buf.reset(buf);
+  this->copied_in = in;
+  this->copied_out = out;
+  VEO_ASSERT(pos == stack_size);
 }
 
 void CallArgs::copyin(std::function<int(uint64_t, const void *, size_t)> xfer)
 {
   if (this->copied_in) {
     VEO_TRACE(nullptr, "transfer stack image (VH %p -> VE %#lx, %d bytes)",
-              this->stack_buf.get(), this->stack_top, this->stack_size);
-    xfer(this->stack_top, this->stack_buf.get(), this->stack_size);
+              this->stack_image, this->stack_top, this->stack_size);
+    xfer(this->stack_top, this->stack_image, this->stack_size);
   } else {
     VEO_TRACE(nullptr, "the current stack (%#lx) is not copied in.",
               this->stack_top);
   }
+  // write the data on VE heap directly from the buffer on VH
+  auto end = this->slots + this->num_args;
+  for (auto a = this->slots; a != end; ++a) {
+    if (a->kind != internal::ArgSlot::STACK || !a->on_heap || !a->in)
+      continue;
+    VEO_DEBUG(nullptr, "copy in to VE heap: %p -> %#lx, size = %d",
+      a->src, a->value, a->len);
+    xfer(a->value, a->src, a->len);
+  }
 }
 
+/**
+ * @brief copy arguments out from VE
+ *
+ * Only arguments with VEO_INTENT_OUT or VEO_INTENT_INOUT are read,
+ * directly into the buffers on VH.
+ */
 void CallArgs::copyout(std::function<int(void *, uint64_t, size_t)> xfer)
 {
-  if (this->copied_out) {
-    VEO_TRACE(nullptr, "transfer stack image (VE %#lx -> VH %p, %d bytes)",
-              this->stack_top, this->stack_buf.get(), this->stack_size);
-    xfer(this->stack_buf.get(), this->stack_top, this->stack_size);
-    for (auto &arg: this->arguments) {
-      arg->copyoutFromStackImage(this->stack_top, this->stack_buf.get());
-    }
-  } else {
+  if (!this->copied_out) {
     VEO_TRACE(nullptr, "the current stack (%#lx) is not copied out.",
               this->stack_top);
+    return;
+  }
+  auto end = this->slots + this->num_args;
+  for (auto a = this->slots; a != end; ++a) {
+    if (a->kind != internal::ArgSlot::STACK || !a->out)
+      continue;
+    VEO_DEBUG(nullptr, "copy out to VH: %#lx -> %p, size = %d",
+      a->value, a->buff, a->len);
+    xfer(a->buff, a->value, a->len);
   }
 }
 } // namespace veo
@@ -7,48 +7,122 @@
  */
 #ifndef _VEO_CALL_ARGS_HPP_
 #define _VEO_CALL_ARGS_HPP_
+#include <cstdint>
+#include <cstring>
 #include <functional>
 #include <memory>
 #include <string>
-#include <vector>
-#include <type_traits>
 #include <initializer_list>
+#include <vector>
 #include "ve_offload.h"
 #include "VEOException.hpp"
 
 namespace veo {
+class ThreadContext;
+
 constexpr int NUM_ARGS_ON_REGISTER = 8;
 constexpr int PARAM_AREA_OFFSET = 176;
 namespace internal {
 /**
- * Base abstract class of an argument
+ * @brief an argument held inline in CallArgs
+ *
+ * A scalar holds the value set to a register or the parameter area;
+ * an argument on stack holds the buffer on VH and, after setup, its
+ * VEMVA as the value.
  */
-struct ArgBase {
-  virtual ~ArgBase() = default;
-  virtual int64_t getRegVal(uint64_t, int, size_t &) const = 0;
-  virtual size_t sizeOnStack() const = 0;
-  virtual void setStackImage(uint64_t, std::string &, int, bool &, bool &) = 0;
-  virtual void copyoutFromStackImage(uint64_t, const char *) = 0;
+struct ArgSlot {
+  enum Kind: uint8_t {
+    NONE,//!< not set; passed as zero
+    VALUE,//!< scalar
+    STACK,//!< buffer on VE stack or heap
+  };
+  Kind kind;
+  bool in;// copy in from VH memory to VE
+  bool out;// copy out to VH memory from VE
+  bool on_heap;// placed on VE heap instead of stack
+  uint64_t value;
+  char *buff;// VH buffer set; copied out to
+  const char *src;// data copied in; buff or a copy in a snapshot
+  size_t len;
+
+  /**
+   * @brief size of the buffer on stack, 8 byte-aligned
+   */
+  size_t sizeOnStack() const {
+    if (this->kind != STACK || this->on_heap)
+      return 0;
+    return (this->len + 7) & ~7UL;
+  }
+  /**
+   * @brief size of the buffer if placed on VE heap
+   */
+  size_t sizeOnHeap(size_t threshold) const {
+    constexpr size_t alignment = 64;
+    if (this->kind != STACK || this->len <= threshold)
+      return 0;
+    return (this->len + alignment - 1) & ~(alignment - 1);
+  }
 };
+
+/**
+ * @brief a value on register of a scalar argument
+ */
+//XXX: long double and _Complex are not supported.
+inline uint64_t reg_value(int64_t v) { return v; }
+inline uint64_t reg_value(uint64_t v) { return v; }
+inline uint64_t reg_value(int32_t v) { return static_cast<int64_t>(v); }
+inline uint64_t reg_value(uint32_t v) { return v; }
+inline uint64_t reg_value(double v)
+{
+  uint64_t rv;
+  std::memcpy(&rv, &v, sizeof(rv));
+  return rv;
+}
+/**
+ * @brief a float is passed in the upper half of a register on VE.
+ */
+inline uint64_t reg_value(float v)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &v, sizeof(bits));
+  return static_cast<uint64_t>(bits) << 32;
+}
 } // namespace internal
 
+/**
+ * @brief reusable buffer for stack images owned by a context
+ */
+class StackBuffer {
+  char *buf;
+  size_t capacity;
+public:
+  StackBuffer(): buf(nullptr), capacity(0) {}
+  ~StackBuffer();
+  StackBuffer(const StackBuffer &) = delete;
+  char *get(size_t);
+};
+
 class CallArgs {
-  std::vector<std::unique_ptr<internal::ArgBase> > arguments;
+  internal::ArgSlot slots[VEO_MAX_NUM_ARGS];
+  int num_args;
   template<typename T> void push_(T val);
   template<typename T> void set_(int argnum, T val);
+  internal::ArgSlot &slot(int);
 
   uint64_t stack_top;
   size_t stack_size;
-  std::unique_ptr<char> stack_buf;
+  char *stack_image;// in the buffer of the context calling with this
 
   bool copied_in;// necessary to copy stack image to VE
-  bool copied_out;// necessary to copy stack image out from VE
+  bool copied_out;// necessary to copy arguments out from VE
 
-  std::string getStackImage(uint64_t &);
+  bool snapshot_mode;// calls take a snapshot of arguments on submission
+  std::vector<char> data;// data in held by a snapshot
 
 public:
-  CallArgs(): arguments(0) {}
-  CallArgs(std::initializer_list<int64_t> args) {
+  CallArgs(): num_args(0), snapshot_mode(false) {}
+  CallArgs(std::initializer_list<int64_t> args): num_args(0),
+    snapshot_mode(false) {
     for (auto a: args)
       this->push_(a);
   }
@@ -59,7 +133,7 @@ public:
    * @brief clear all aruguments
    */
   void clear() {
-    this->arguments.clear();
+    this->num_args = 0;
   }
 
   /**
@@ -80,12 +154,20 @@ public:
    * @brief number of arguments for VEO function
    */
   int numArgs() const {
-    return this->arguments.size();
+    return this->num_args;
   }
 
-  std::vector<uint64_t> getRegVal(uint64_t) const;
+  int getRegVal(uint64_t *) const;
+
+  /**
+   * @brief enable or disable snapshot on submission of calls
+   */
+  void setSnapshot(bool enable) {
+    this->snapshot_mode = enable;
+  }
+  std::shared_ptr<CallArgs> snapshot() const;
 
-  void setup(uint64_t &);
+  void setup(uint64_t &, StackBuffer &, ThreadContext *heap = nullptr);
   void copyin(std::function<int(uint64_t, const void *, size_t)>);
   void copyout(std::function<int(void *, uint64_t, size_t)>);
 
@@ -0,0 +1,199 @@
+/**
+ * @file ContextGroup.cpp
+ * @brief implementation of ContextGroup
+ */
+#include <algorithm>
+#include "ContextGroup.hpp"
+#include "CallArgs.hpp"
+#include "ProcHandle.hpp"
+#include "ThreadContext.hpp"
+#include "VEOException.hpp"
+#include "log.hpp"
+
+namespace veo {
+/**
+ * @brief constructor opening contexts
+ *
+ * @param p VE process
+ * @param n the number of contexts to open
+ */
+ContextGroup::ContextGroup(ProcHandle *p, int n): proc(p),
+  contexts(n > 0 ? n : 0), owns_contexts(true), seq_no(0)
+{
+  if (n <= 0) {
+    throw VEOException("invalid number of contexts", EINVAL);
+  }
+  p->openContexts(n, this->contexts.data());
+}
+
+/**
+ * @brief constructor from contexts opened
+ *
+ * @param ctxs contexts; the index is the rank in the group.
+ * @param n the number of contexts
+ */
+ContextGroup::ContextGroup(ThreadContext **ctxs, int n): proc(nullptr),
+  owns_contexts(false), seq_no(0)
+{
+  if (n <= 0) {
+    throw VEOException("invalid number of contexts", EINVAL);
+  }
+  this->proc = ctxs[0]->procHandle();
+  for (int i = 0; i < n; ++i) {
+    if (ctxs[i]->procHandle() != this->proc || ctxs[i]->isMainThread()) {
+      throw VEOException("invalid context in group", EINVAL);
+    }
+    this->contexts.push_back(ctxs[i]);
+  }
+}
+
+/**
+ * @brief get a context in the group
+ *
+ * @param rank rank of the context
+ */
+ThreadContext *ContextGroup::get(int rank) const
+{
+  if (rank < 0 || rank >= this->size()) {
+    throw VEOException("invalid rank", EINVAL);
+  }
+  return this->contexts[rank];
+}
+
+/**
+ * @brief call a function on all contexts
+ *
+ * @param addr VEMVA of the function
+ * @param builder callback to set arguments for each rank; can be nullptr.
+ * @param data data passed to builder
+ * @return request ID of the group
+ *
+ * The argument #0 is the rank and #1 is the size of the group;
+ * builder sets the argument #2 and later. Calls are queued to all
+ * contexts before any of them is waited for.
+ */
+uint64_t ContextGroup::callAll(uint64_t addr, veo_args_builder builder,
+                               void *data)
+{
+  int n = this->size();
+  std::unique_ptr<GroupRequest> req(new GroupRequest);
+  req->args.resize(n);
+  req->reqids.resize(n, VEO_REQUEST_ID_INVALID);
+  req->done.resize(n, false);
+  req->claimed.resize(n, false);
+  req->retvals.resize(n, 0);
+  req->status = VEO_COMMAND_OK;
+  for (int i = 0; i < n; ++i) {
+    req->args[i].reset(new CallArgs());
+    auto &args = *req->args[i];
+    args.set(0, static_cast<int64_t>(i));
+    args.set(1, static_cast<int64_t>(n));
+    if (builder != nullptr && builder(args.toCHandle(), i, n, data) != 0) {
+      throw VEOException("failed to build arguments", EINVAL);
+    }
+  }
+  // fan out
+  int issued = 0;
+  try {
+    for (; issued < n; ++issued) {
+      req->reqids[issued] = this->contexts[issued]->callAsync(addr,
+                              *req->args[issued]);
+    }
+  } catch (VEOException &e) {
+    // calls queued refer to the arguments in req; wait for them.
+    for (int i = 0; i < issued; ++i) {
+      uint64_t ret;
+      this->contexts[i]->callWaitResult(req->reqids[i], &ret);
+    }
+    throw;
+  }
+  std::lock_guard<std::mutex> lock(this->mtx);
+  auto id = this->seq_no++;
+  this->requests[id] = std::move(req);
+  return id;
+}
+
+/**
+ * @brief collect results of a call on all contexts
+ *
+ * @param reqid request ID of the group
+ * @param[out] retvals array to store the return value of each rank;
+ *             can be nullptr.
+ * @param wait true to wait for all contexts
+ * @return VEO_COMMAND_OK if all calls succeeded; the status of the first
+ *         failed rank, otherwise; VEO_COMMAND_UNFINISHED if not all calls
+ *         finished and wait is false.
+ *
+ * A rank is claimed by one thread while its result is collected; other
+ * threads waiting for the request wait for the claim to be released.
+ */
+int ContextGroup::collect(uint64_t reqid, uint64_t *retvals, bool wait)
+{
+  std::shared_ptr<GroupRequest> req;
+  std::unique_lock<std::mutex> lock(this->mtx);
+  auto itr = this->requests.find(reqid);
+  if (itr == this->requests.end())
+    return VEO_COMMAND_ERROR;
+  req = itr->second;
+  // fan in
+  bool finished = true;
+  for (int i = 0; i < this->size(); ++i) {
+    if (wait) {
+      this->cond.wait(lock, [&req, i]{
+        return req->done[i] || !req->claimed[i]; });
+    }
+    if (req->done[i])
+      continue;
+    if (req->claimed[i]) {
+      finished = false;// being collected by another thread
+      continue;
+    }
+    req->claimed[i] = true;
+    lock.unlock();
+    auto ctx = this->contexts[i];
+    uint64_t ret;
+    int rv = wait ? ctx->callWaitResult(req->reqids[i], &ret)
+                  : ctx->callPeekResult(req->reqids[i], &ret);
+    lock.lock();
+    req->claimed[i] = false;
+    this->cond.notify_all();
+    if (rv == VEO_COMMAND_UNFINISHED) {
+      finished = false;
+      continue;
+    }
+    req->done[i] = true;
+    req->retvals[i] = ret;
+    if (rv != VEO_COMMAND_OK && req->status == VEO_COMMAND_OK) {
+      VEO_ERROR(ctx, "rank %d of group request #%lu failed (%d)",
+                i, reqid, rv);
+      req->status = rv;
+    }
+  }
+  if (!finished)
+    return VEO_COMMAND_UNFINISHED;
+  if (retvals != nullptr)
+    std::copy(req->retvals.begin(), req->retvals.end(), retvals);
+  this->requests.erase(reqid);
+  return req->status;
+}
+
+/**
+ * @brief close the group
+ *
+ * @return zero upon success; non-zero upon failure.
+ *
+ * Contexts opened by the group are closed.
+ */
+int ContextGroup::close()
+{
+  if (!this->owns_contexts)
+    return 0;
+  int rv = 0;
+  for (auto ctx: this->contexts) {
+    int rv_ = this->proc->closeContext(ctx);
+    if (rv_ != 0)
+      rv = rv_;
+  }
+  return rv;
+}
+} // namespace veo
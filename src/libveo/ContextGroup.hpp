@@ -0,0 +1,73 @@
+/**
+ * @file ContextGroup.hpp
+ * @brief group of VEO contexts running the same function
+ */
+#ifndef _VEO_CONTEXT_GROUP_HPP_
+#define _VEO_CONTEXT_GROUP_HPP_
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <ve_offload.h>
+
+namespace veo {
+class CallArgs;
+class ProcHandle;
+class ThreadContext;
+
+/**
+ * @brief group of VEO contexts
+ *
+ * A function is called on all contexts of a group at once (SPMD); the
+ * rank of the context in the group and the size of the group are passed
+ * as the first two arguments.
+ */
+class ContextGroup {
+private:
+  /**
+   * @brief a call on all contexts
+   */
+  struct GroupRequest {
+    std::vector<std::unique_ptr<CallArgs> > args;
+    std::vector<uint64_t> reqids;//!< request IDs on each context
+    std::vector<bool> done;//!< results collected
+    std::vector<bool> claimed;//!< results being collected by a thread
+    std::vector<uint64_t> retvals;
+    int status;//!< the first failure; VEO_COMMAND_OK if none
+  };
+  ProcHandle *proc;
+  std::vector<ThreadContext *> contexts;
+  bool owns_contexts;//!< the contexts are opened by this group
+  std::mutex mtx;
+  std::condition_variable cond;//!< notified when a claim is released
+  std::unordered_map<uint64_t, std::shared_ptr<GroupRequest> > requests;
+  uint64_t seq_no;
+
+  int collect(uint64_t, uint64_t *, bool);
+public:
+  ContextGroup(ProcHandle *, int);
+  ContextGroup(ThreadContext **, int);
+  ContextGroup(const ContextGroup &) = delete;
+
+  int size() const { return this->contexts.size(); }
+  ThreadContext *get(int) const;
+  ProcHandle *procHandle() const { return this->proc; }
+  uint64_t callAll(uint64_t, veo_args_builder, void *);
+  int parallelFor(uint64_t, size_t, size_t, size_t, const veo_pfor_buf *,
+                  int);
+  int waitResult(uint64_t reqid, uint64_t *retvals) {
+    return this->collect(reqid, retvals, true);
+  }
+  int peekResult(uint64_t reqid, uint64_t *retvals) {
+    return this->collect(reqid, retvals, false);
+  }
+  int close();
+
+  veo_ctxt_group *toCHandle() {
+    return reinterpret_cast<veo_ctxt_group *>(this);
+  }
+};
+} // namespace veo
+#endif
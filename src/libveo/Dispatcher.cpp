@@ -0,0 +1,443 @@
+/**
+ * @file Dispatcher.cpp
+ * @brief implementation of Dispatcher
+ */
+#include <algorithm>
+#include "Dispatcher.hpp"
+#include "CommandImpl.hpp"
+#include "ProcHandle.hpp"
+#include "ThreadContext.hpp"
+#include "VEOException.hpp"
+#include "log.hpp"
+
+namespace veo {
+Dispatcher::Dispatcher(ProcHandle *p): proc(p), seq_no(0), scaling(),
+  scaling_enabled(false)
+{
+}
+
+Dispatcher::~Dispatcher()
+{
+  this->setScaling(nullptr);
+}
+
+/**
+ * @brief add contexts to the dispatcher
+ *
+ * @param n the number of contexts to open and add
+ */
+void Dispatcher::addContexts(int n)
+{
+  if (n <= 0)
+    return;
+  std::vector<ThreadContext *> ctxs(n);
+  this->proc->openContexts(n, ctxs.data(), false);
+  std::lock_guard<std::mutex> lock(this->mtx);
+  for (auto ctx: ctxs) {
+    VEO_DEBUG(ctx, "context %p is added to dispatcher", ctx);
+    this->workers.emplace_back(new Worker(ctx));
+  }
+}
+
+/**
+ * @brief close all contexts of the dispatcher
+ *
+ * Scaling is disabled. Calls queued are executed before the contexts
+ * are closed; calls submitted later open a new context. Results not
+ * taken are dropped.
+ */
+void Dispatcher::closeAll()
+{
+  this->setScaling(nullptr);
+  std::vector<std::unique_ptr<Worker> > workers;
+  {
+    std::lock_guard<std::mutex> lock(this->mtx);
+    workers.swap(this->workers);
+  }
+  // workers are kept until closed; their pull commands refer to them.
+  std::unordered_set<ThreadContext *> closed;
+  for (auto &w: workers) {
+    closed.insert(w->ctx);
+    if (w->ctx->close() == 0)
+      delete w->ctx;
+    else
+      VEO_ERROR(w->ctx, "failed to close context %p", w->ctx);
+  }
+  std::vector<ThreadContext *> retired;
+  {
+    std::lock_guard<std::mutex> lock(this->mtx);
+    retired.swap(this->retired);
+  }
+  for (auto ctx: retired) {
+    if (closed.find(ctx) != closed.end())
+      continue;// retired while being closed above
+    if (ctx->close() == 0)
+      delete ctx;
+    else
+      VEO_ERROR(ctx, "failed to close context %p", ctx);
+  }
+  std::lock_guard<std::mutex> lock(this->mtx);
+  this->pending.clear();
+  this->results.clear();
+}
+
+/**
+ * @brief find the least loaded context
+ *
+ * The caller must hold mtx.
+ */
+Dispatcher::Worker *Dispatcher::leastLoaded()
+{
+  Worker *rv = nullptr;
+  for (auto &w: this->workers) {
+    if (rv == nullptr || w->jobs.size() < rv->jobs.size() ||
+        (w->jobs.size() == rv->jobs.size() && w->pulls < rv->pulls))
+      rv = w.get();
+  }
+  return rv;
+}
+
+/**
+ * @brief find the most loaded context to steal a call from
+ *
+ * @param thief context stealing a call
+ * @return context with the deepest deque; nullptr if no calls are queued.
+ *
+ * The caller must hold mtx.
+ */
+Dispatcher::Worker *Dispatcher::mostLoaded(Worker *thief)
+{
+  Worker *rv = nullptr;
+  for (auto &w: this->workers) {
+    if (w.get() == thief || w->jobs.empty())
+      continue;
+    if (rv == nullptr || w->jobs.size() > rv->jobs.size())
+      rv = w.get();
+  }
+  return rv;
+}
+
+/**
+ * @brief send a pull command to a context
+ *
+ * The caller must hold mtx.
+ */
+void Dispatcher::sendPull(Worker *w)
+{
+  ++w->pulls;
+  auto f = [this, w](Command *) { return this->pull(w); };
+  std::unique_ptr<Command> req(
+    new internal::CommandImpl(VEO_REQUEST_ID_INVALID, f));
+  w->ctx->comq.pushRequest(std::move(req));
+}
+
+/**
+ * @brief queue a call to the least loaded context
+ *
+ * The caller must hold mtx.
+ */
+void Dispatcher::enqueue(std::unique_ptr<Job> job)
+{
+  auto w = this->leastLoaded();
+  if (w == nullptr) {
+    VEO_ERROR(nullptr, "no context to execute request #%lu",
+              job->result->getID());
+    job->result->setResult(0, VEO_COMMAND_ERROR);
+    this->results[job->result->getID()] = std::move(job->result);
+    this->cond.notify_all();
+    return;
+  }
+  w->jobs.push_back(std::move(job));
+  this->sendPull(w);
+}
+
+/**
+ * @brief remove a context no longer usable
+ *
+ * Calls queued to the context are moved to the other contexts. The
+ * context is closed by closeAll().
+ * The caller must hold mtx.
+ */
+void Dispatcher::retire(Worker *w)
+{
+  VEO_ERROR(w->ctx, "context %p is removed from dispatcher", w->ctx);
+  this->retired.push_back(w->ctx);
+  auto jobs = std::move(w->jobs);
+  for (auto itr = this->workers.begin(); itr != this->workers.end(); ++itr) {
+    if (itr->get() == w) {
+      this->workers.erase(itr);
+      break;
+    }
+  }
+  for (auto &job: jobs)
+    this->enqueue(std::move(job));
+}
+
+/**
+ * @brief handler of a pull command
+ *
+ * @param w context executing the command
+ * @return zero upon success; non-zero if the VE thread can no longer be
+ *         used.
+ */
+int64_t Dispatcher::pull(Worker *w)
+{
+  std::unique_ptr<Job> job;
+  clock::time_point start;
+  {
+    std::lock_guard<std::mutex> lock(this->mtx);
+    --w->pulls;
+    if (!w->jobs.empty()) {
+      job = std::move(w->jobs.front());
+      w->jobs.pop_front();
+    } else {
+      auto victim = this->mostLoaded(w);
+      if (victim == nullptr)
+        return 0;
+      job = std::move(victim->jobs.back());
+      victim->jobs.pop_back();
+      ++w->stolen;
+      VEO_TRACE(w->ctx, "request #%lu is stolen from %p",
+                job->result->getID(), victim->ctx);
+    }
+    // a running context is never closed by scaleStep().
+    w->running = true;
+    start = clock::now();
+    w->last_active = start;
+  }
+  auto rv = w->ctx->_execCall(job->result.get(), job->addr, *job->args);
+  auto end = clock::now();
+
+  std::lock_guard<std::mutex> lock(this->mtx);
+  w->running = false;
+  w->busy += std::chrono::duration<double>(end - start).count();
+  w->last_active = end;
+  ++w->executed;
+  this->results[job->result->getID()] = std::move(job->result);
+  this->cond.notify_all();
+  if (rv != 0) {
+    this->retire(w);
+  } else if (w->pulls == 0 && this->mostLoaded(w) != nullptr) {
+    this->sendPull(w);// idle; try to steal.
+  }
+  return rv;
+}
+
+/**
+ * @brief submit a call
+ *
+ * @param addr VEMVA of VE function to call
+ * @param args arguments of the function
+ * @return request ID
+ *
+ * A context is opened if the dispatcher has none.
+ */
+uint64_t Dispatcher::submit(uint64_t addr, CallArgs &args)
+{
+  bool empty;
+  {
+    std::lock_guard<std::mutex> lock(this->mtx);
+    empty = this->workers.empty();
+  }
+  if (empty)
+    this->addContexts(1);
+
+  std::lock_guard<std::mutex> lock(this->mtx);
+  uint64_t id = this->seq_no++;
+  if (id == VEO_REQUEST_ID_INVALID)
+    id = this->seq_no++;
+  auto dummy = [](Command *)->int64_t{return 0;};
+  std::unique_ptr<Job> job(new Job);
+  job->addr = addr;
+  job->snapshot = args.snapshot();
+  job->args = job->snapshot ? job->snapshot.get() : &args;
+  job->result.reset(new internal::CommandImpl(id, dummy));
+  job->submitted = clock::now();
+  this->pending.insert(id);
+  this->enqueue(std::move(job));
+  return id;
+}
+
+/**
+ * @brief wait for the result of a call
+ *
+ * @param reqid request ID
+ * @param retp pointer to buffer to store the return value.
+ * @return command status, as ThreadContext::callWaitResult().
+ */
+int Dispatcher::waitResult(uint64_t reqid, uint64_t *retp)
+{
+  std::unique_lock<std::mutex> lock(this->mtx);
+  if (this->pending.find(reqid) == this->pending.end())
+    return VEO_COMMAND_ERROR;
+  auto itr = this->results.find(reqid);
+  while (itr == this->results.end()) {
+    this->cond.wait(lock);
+    itr = this->results.find(reqid);
+  }
+  auto c = std::move(itr->second);
+  this->results.erase(itr);
+  this->pending.erase(reqid);
+  *retp = c->getRetval();
+  return c->getStatus();
+}
+
+/**
+ * @brief check if the result of a call is available
+ *
+ * @param reqid request ID
+ * @param retp pointer to buffer to store the return value.
+ * @return command status, as ThreadContext::callPeekResult().
+ */
+int Dispatcher::peekResult(uint64_t reqid, uint64_t *retp)
+{
+  std::lock_guard<std::mutex> lock(this->mtx);
+  if (this->pending.find(reqid) == this->pending.end())
+    return VEO_COMMAND_ERROR;
+  auto itr = this->results.find(reqid);
+  if (itr == this->results.end())
+    return VEO_COMMAND_UNFINISHED;
+  auto c = std::move(itr->second);
+  this->results.erase(itr);
+  this->pending.erase(reqid);
+  *retp = c->getRetval();
+  return c->getStatus();
+}
+
+/**
+ * @brief get statistics of contexts
+ *
+ * @param[out] stats array to store statistics
+ * @param n the number of elements of stats
+ * @return the number of contexts in the dispatcher
+ *
+ * At most n elements are stored.
+ */
+int Dispatcher::getStats(veo_dispatch_stats *stats, int n)
+{
+  auto now = clock::now();
+  std::lock_guard<std::mutex> lock(this->mtx);
+  int i = 0;
+  for (auto &w: this->workers) {
+    if (i >= n)
+      break;
+    auto elapsed = std::chrono::duration<double>(now - w->since).count();
+    stats[i].ctx = w->ctx->toCHandle();
+    stats[i].executed = w->executed;
+    stats[i].stolen = w->stolen;
+    stats[i].queued = w->jobs.size();
+    stats[i].busy = w->busy;
+    stats[i].utilization = elapsed > 0 ? w->busy / elapsed : 0;
+    ++i;
+  }
+  return this->workers.size();
+}
+
+/**
+ * @brief enable or disable elastic scaling of contexts
+ *
+ * @param conf parameters of scaling; nullptr to disable.
+ */
+void Dispatcher::setScaling(const veo_dispatch_scaling *conf)
+{
+  std::lock_guard<std::mutex> scaling_lock(this->scaling_mtx);
+  {
+    std::lock_guard<std::mutex> lock(this->mtx);
+    this->scaling_enabled = false;
+    this->monitor_cond.notify_all();
+  }
+  if (this->monitor.joinable())
+    this->monitor.join();
+  if (conf == nullptr)
+    return;
+  if (conf->max_contexts < 1 || conf->min_contexts < 0 ||
+      conf->min_contexts > conf->max_contexts || conf->interval <= 0) {
+    throw VEOException("invalid scaling parameters", EINVAL);
+  }
+  std::lock_guard<std::mutex> lock(this->mtx);
+  this->scaling = *conf;
+  this->scaling_enabled = true;
+  this->monitor = std::thread(&Dispatcher::monitorLoop, this);
+}
+
+/**
+ * @brief open or close a context according to the load
+ *
+ * @return 1 if a context is opened, -1 if closed and 0 otherwise.
+ */
+int Dispatcher::scaleStep()
+{
+  auto now = clock::now();
+  ThreadContext *to_close = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(this->mtx);
+    const auto &conf = this->scaling;
+    int n = this->workers.size();
+    size_t queued = 0;
+    double wait = 0;
+    for (auto &w: this->workers) {
+      queued += w->jobs.size();
+      if (!w->jobs.empty()) {
+        auto t = std::chrono::duration<double>(
+                   now - w->jobs.front()->submitted).count();
+        wait = std::max(wait, t);
+      }
+    }
+    bool overloaded =
+      (conf.queue_depth > 0 && queued > (size_t)conf.queue_depth * n) ||
+      (conf.wait_time > 0 && wait > conf.wait_time);
+    if (n < conf.min_contexts || (n < conf.max_contexts && overloaded)) {
+      VEO_DEBUG(nullptr, "grow: %d contexts, %lu calls queued, wait %f sec",
+                n, queued, wait);
+    } else if (n > conf.min_contexts && conf.idle_time > 0) {
+      for (auto itr = this->workers.begin(); itr != this->workers.end();
+           ++itr) {
+        auto &w = *itr;
+        auto idle = std::chrono::duration<double>(
+                      now - w->last_active).count();
+        if (w->jobs.empty() && w->pulls == 0 && !w->running &&
+            idle > conf.idle_time) {
+          VEO_DEBUG(w->ctx, "shrink: context %p idle for %f sec",
+                    w->ctx, idle);
+          to_close = w->ctx;
+          this->workers.erase(itr);
+          break;
+        }
+      }
+      if (to_close == nullptr)
+        return 0;
+    } else {
+      return 0;
+    }
+  }
+  if (to_close != nullptr) {
+    // terminate the VE thread to release the VE core.
+    if (to_close->close() == 0)
+      delete to_close;
+    return -1;
+  }
+  this->addContexts(1);
+  return 1;
+}
+
+/**
+ * @brief main loop of the monitor thread
+ */
+void Dispatcher::monitorLoop()
+{
+  std::unique_lock<std::mutex> lock(this->mtx);
+  while (this->scaling_enabled) {
+    auto interval = std::chrono::duration<double>(this->scaling.interval);
+    this->monitor_cond.wait_for(lock, interval);
+    if (!this->scaling_enabled)
+      break;
+    lock.unlock();
+    try {
+      this->scaleStep();
+    } catch (VEOException &e) {
+      VEO_ERROR(nullptr, "failed to scale contexts: %s", e.what());
+    }
+    lock.lock();
+  }
+}
+} // namespace veo
@@ -0,0 +1,105 @@
+/**
+ * @file Dispatcher.hpp
+ * @brief process-wide scheduler of calls across VEO contexts
+ */
+#ifndef _VEO_DISPATCHER_HPP_
+#define _VEO_DISPATCHER_HPP_
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <ve_offload.h>
+#include "Command.hpp"
+
+namespace veo {
+class CallArgs;
+class ProcHandle;
+class ThreadContext;
+
+/**
+ * @brief scheduler of calls submitted to a VE process
+ *
+ * Each context owned by the dispatcher has a deque of calls. A call is
+ * queued to the least loaded context, and a "pull" command is sent to
+ * the context. A pull command runs the first call in the deque of its
+ * context, or steals the last call from the most loaded context if the
+ * deque is empty. A context which has no pull commands left after a call
+ * pulls once more to steal from the others.
+ *
+ * With elastic scaling enabled, a monitor thread opens a context when
+ * calls wait too long or too many, and closes a context idle for a while.
+ */
+class Dispatcher {
+private:
+  typedef std::chrono::steady_clock clock;
+  /**
+   * @brief a call submitted
+   */
+  struct Job {
+    uint64_t addr;
+    CallArgs *args;
+    std::shared_ptr<CallArgs> snapshot;//!< args if snapshot mode
+    std::unique_ptr<Command> result;
+    clock::time_point submitted;
+  };
+  /**
+   * @brief a context owned by the dispatcher
+   */
+  struct Worker {
+    ThreadContext *ctx;
+    std::deque<std::unique_ptr<Job> > jobs;
+    int pulls;//!< pull commands sent but not executed
+    bool running;//!< executing a call
+    uint64_t executed;
+    uint64_t stolen;
+    double busy;//!< time executing calls in seconds
+    clock::time_point since;//!< time attached
+    clock::time_point last_active;//!< time the last call finished
+    explicit Worker(ThreadContext *c): ctx(c), pulls(0), running(false),
+      executed(0),
+      stolen(0), busy(0), since(clock::now()), last_active(since) {}
+  };
+  ProcHandle *proc;
+  std::mutex mtx;
+  std::condition_variable cond;//!< notified on completion of a call
+  std::vector<std::unique_ptr<Worker> > workers;
+  std::vector<ThreadContext *> retired;//!< contexts removed on an error
+  std::unordered_set<uint64_t> pending;//!< calls of which result not taken
+  std::unordered_map<uint64_t, std::unique_ptr<Command> > results;
+  uint64_t seq_no;
+  // elastic scaling
+  veo_dispatch_scaling scaling;
+  bool scaling_enabled;
+  std::thread monitor;
+  std::mutex scaling_mtx;//!< serializes setScaling() joining the monitor
+  std::condition_variable monitor_cond;//!< notified to stop the monitor
+
+  Worker *leastLoaded();
+  Worker *mostLoaded(Worker *);
+  void sendPull(Worker *);
+  void enqueue(std::unique_ptr<Job>);
+  void retire(Worker *);
+  int64_t pull(Worker *);
+  int scaleStep();
+  void monitorLoop();
+public:
+  explicit Dispatcher(ProcHandle *);
+  ~Dispatcher();
+  Dispatcher(const Dispatcher &) = delete;
+
+  void addContexts(int);
+  void closeAll();
+  uint64_t submit(uint64_t, CallArgs &);
+  int waitResult(uint64_t, uint64_t *);
+  int peekResult(uint64_t, uint64_t *);
+  int getStats(veo_dispatch_stats *, int);
+  void setScaling(const veo_dispatch_scaling *);
+};
+} // namespace veo
+#endif
@@ -0,0 +1,283 @@
+/**
+ * @file HostMemRegistry.cpp
+ * @brief implementation of HostMemRegistry
+ */
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* VE OS internal headers */
+extern "C" {
+#include "handle.h"
+}
+
+#include "HostMemRegistry.hpp"
+#include "VEOException.hpp"
+#include "log.hpp"
+
+namespace veo {
+namespace internal {
+constexpr size_t default_bounce_size = 0;
+
+uintptr_t page_down(uintptr_t addr)
+{
+  return addr & ~(static_cast<uintptr_t>(getpagesize()) - 1);
+}
+
+uintptr_t page_up(uintptr_t addr)
+{
+  return page_down(addr + getpagesize() - 1);
+}
+
+/**
+ * @brief pages locked by registries of all VE processes
+ *
+ * mlock() applies to the whole host process, so the pages are counted
+ * across registries: the key is the start of a range and the value is
+ * the number of registrations of the pages up to the next key.
+ */
+std::map<uintptr_t, int> locked_pages;
+std::mutex locked_pages_mtx;
+
+/**
+ * @brief make a range of locked_pages start at an address
+ */
+std::map<uintptr_t, int>::iterator split_pages(uintptr_t addr)
+{
+  auto itr = locked_pages.upper_bound(addr);
+  int count = 0;
+  if (itr != locked_pages.begin()) {
+    auto prev = std::prev(itr);
+    if (prev->first == addr)
+      return prev;
+    count = prev->second;
+  }
+  return locked_pages.emplace_hint(itr, addr, count);
+}
+
+/**
+ * @brief remove ranges of locked_pages with the same count as the previous
+ */
+void merge_pages()
+{
+  int count = 0;
+  for (auto itr = locked_pages.begin(); itr != locked_pages.end(); ) {
+    if (itr->second == count) {
+      itr = locked_pages.erase(itr);
+    } else {
+      count = itr->second;
+      ++itr;
+    }
+  }
+}
+
+/**
+ * @brief lock pages of host memory
+ */
+void lock_pages(uintptr_t start, size_t len)
+{
+  std::lock_guard<std::mutex> lock(locked_pages_mtx);
+  if (mlock(reinterpret_cast<void *>(start), len) != 0) {
+    throw VEOException("failed to lock host memory", errno);
+  }
+  auto end = split_pages(page_up(start + len));
+  for (auto itr = split_pages(page_down(start)); itr != end; ++itr)
+    ++itr->second;
+  merge_pages();
+}
+
+/**
+ * @brief unlock pages of host memory not registered any more
+ */
+void unlock_pages(uintptr_t start, size_t len)
+{
+  std::lock_guard<std::mutex> lock(locked_pages_mtx);
+  auto end = split_pages(page_up(start + len));
+  for (auto itr = split_pages(page_down(start)); itr != end; ++itr) {
+    if (--itr->second == 0) {
+      auto next = std::next(itr);
+      munlock(reinterpret_cast<void *>(itr->first),
+              next->first - itr->first);
+    }
+  }
+  merge_pages();
+}
+} // namespace internal
+
+/**
+ * @brief constructor
+ *
+ * The size of bounce buffers is specified by VEO_BOUNCE_SIZE;
+ * staging is disabled by default and when zero.
+ */
+HostMemRegistry::HostMemRegistry():
+  bounce_size(internal::default_bounce_size)
+{
+  const char *env = getenv("VEO_BOUNCE_SIZE");
+  if (env != nullptr)
+    this->bounce_size = strtoul(env, nullptr, 0);
+}
+
+HostMemRegistry::~HostMemRegistry()
+{
+  this->clear();
+  for (auto b: this->bounce_all)
+    munmap(b, this->bounce_size);
+}
+
+/**
+ * @brief register host memory
+ *
+ * @param ptr start of the memory
+ * @param len length of the memory
+ *
+ * The pages of the memory are locked until unregistered; a page also
+ * registered by another VE process stays locked until unregistered by
+ * both.
+ */
+void HostMemRegistry::registerMem(void *ptr, size_t len)
+{
+  auto start = reinterpret_cast<uintptr_t>(ptr);
+  if (ptr == nullptr || len == 0) {
+    throw VEOException("invalid host memory", EINVAL);
+  }
+  std::lock_guard<std::mutex> lock(this->mtx);
+  auto next = this->regions.lower_bound(start);
+  if ((next != this->regions.end() && next->first < start + len) ||
+      (next != this->regions.begin() &&
+       std::prev(next)->first + std::prev(next)->second > start)) {
+    throw VEOException("host memory overlaps registered memory", EBUSY);
+  }
+  internal::lock_pages(start, len);
+  this->regions[start] = len;
+  VEO_DEBUG(nullptr, "host memory %p (%lu bytes) registered", ptr, len);
+}
+
+/**
+ * @brief unregister host memory
+ *
+ * @param ptr start of the memory registered
+ *
+ * Pages shared with other registered memory are kept locked.
+ */
+void HostMemRegistry::unregisterMem(void *ptr)
+{
+  std::lock_guard<std::mutex> lock(this->mtx);
+  auto itr = this->regions.find(reinterpret_cast<uintptr_t>(ptr));
+  if (itr == this->regions.end()) {
+    throw VEOException("host memory not registered", EINVAL);
+  }
+  internal::unlock_pages(itr->first, itr->second);
+  this->regions.erase(itr);
+}
+
+/**
+ * @brief unregister all host memory
+ */
+void HostMemRegistry::clear()
+{
+  std::lock_guard<std::mutex> lock(this->mtx);
+  for (auto &r: this->regions)
+    internal::unlock_pages(r.first, r.second);
+  this->regions.clear();
+}
+
+/**
+ * @brief check if host memory is in a registered memory
+ */
+bool HostMemRegistry::isRegistered(const void *ptr, size_t len)
+{
+  auto start = reinterpret_cast<uintptr_t>(ptr);
+  std::lock_guard<std::mutex> lock(this->mtx);
+  auto itr = this->regions.upper_bound(start);
+  if (itr == this->regions.begin())
+    return false;
+  --itr;
+  return start + len <= itr->first + itr->second;
+}
+
+/**
+ * @brief get a bounce buffer
+ * @return a locked buffer of bounce_size; nullptr if not available.
+ */
+void *HostMemRegistry::getBounce()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->bounce_mtx);
+    if (!this->bounce_free.empty()) {
+      auto b = this->bounce_free.back();
+      this->bounce_free.pop_back();
+      return b;
+    }
+  }
+  auto b = mmap(nullptr, this->bounce_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_LOCKED, -1, 0);
+  if (b == MAP_FAILED) {
+    VEO_DEBUG(nullptr, "failed to allocate bounce buffer (%d)", errno);
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(this->bounce_mtx);
+  this->bounce_all.push_back(b);
+  return b;
+}
+
+void HostMemRegistry::putBounce(void *b)
+{
+  std::lock_guard<std::mutex> lock(this->bounce_mtx);
+  this->bounce_free.push_back(b);
+}
+
+/**
+ * @brief write data to VE memory
+ *
+ * @param handle VEOS handle of the calling thread
+ * @param dst VEMVA to write the data
+ * @param src buffer holding data to write
+ * @param size size to transfer in byte
+ * @return zero upon success; negative upon failure
+ */
+int HostMemRegistry::send(veos_handle *handle, uint64_t dst,
+                          const void *src, size_t size)
+{
+  if (size <= this->bounce_size && size > 0 &&
+      !this->isRegistered(src, size)) {
+    auto b = this->getBounce();
+    if (b != nullptr) {
+      memcpy(b, src, size);
+      auto rv = ve_send_data(handle, dst, size, b);
+      this->putBounce(b);
+      return rv;
+    }
+  }
+  return ve_send_data(handle, dst, size, const_cast<void *>(src));
+}
+
+/**
+ * @brief read data from VE memory
+ *
+ * @param handle VEOS handle of the calling thread
+ * @param[out] dst buffer to store the data
+ * @param src VEMVA to read
+ * @param size size to transfer in byte
+ * @return zero upon success; negative upon failure
+ */
+int HostMemRegistry::recv(veos_handle *handle, void *dst, uint64_t src,
+                          size_t size)
+{
+  if (size <= this->bounce_size && size > 0 &&
+      !this->isRegistered(dst, size)) {
+    auto b = this->getBounce();
+    if (b != nullptr) {
+      auto rv = ve_recv_data(handle, src, size, b);
+      if (rv == 0)
+        memcpy(dst, b, size);
+      this->putBounce(b);
+      return rv;
+    }
+  }
+  return ve_recv_data(handle, src, size, dst);
+}
+} // namespace veo
@@ -0,0 +1,49 @@
+/**
+ * @file HostMemRegistry.hpp
+ * @brief host memory registered for transfers
+ */
+#ifndef _VEO_HOST_MEM_REGISTRY_HPP_
+#define _VEO_HOST_MEM_REGISTRY_HPP_
+#include <map>
+#include <mutex>
+#include <vector>
+
+extern "C" {
+#include <libvepseudo.h>
+}
+
+namespace veo {
+/**
+ * @brief registry of host memory for transfers
+ *
+ * Registration locks the pages of host memory; transfers of registered
+ * memory take the same path as the others. If VEO_BOUNCE_SIZE is set,
+ * small transfers from or to memory not registered are staged through
+ * bounce buffers locked in advance and pooled; registered memory and
+ * larger transfers are never staged.
+ */
+class HostMemRegistry {
+private:
+  std::mutex mtx;
+  std::map<uintptr_t, size_t> regions;//!< start -> length
+  std::mutex bounce_mtx;
+  std::vector<void *> bounce_free;//!< bounce buffers not in use
+  std::vector<void *> bounce_all;
+  size_t bounce_size;//!< size of a bounce buffer; zero to disable
+
+  bool isRegistered(const void *, size_t);
+  void *getBounce();
+  void putBounce(void *);
+public:
+  HostMemRegistry();
+  ~HostMemRegistry();
+  HostMemRegistry(const HostMemRegistry &) = delete;
+
+  void registerMem(void *, size_t);
+  void unregisterMem(void *);
+  void clear();
+  int send(veos_handle *, uint64_t, const void *, size_t);
+  int recv(veos_handle *, void *, uint64_t, size_t);
+};
+} // namespace veo
+#endif
@@ -0,0 +1,210 @@
+/**
+ * @file IovTransfer.cpp
+ * @brief implementation of scatter-gather transfers
+ */
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <vector>
+
+/* VE OS internal headers */
+extern "C" {
+#include "handle.h"
+}
+
+#include "ProcHandle.hpp"
+#include "ThreadContext.hpp"
+#include "CommandImpl.hpp"
+#include "VEOException.hpp"
+#include "log.hpp"
+
+namespace veo {
+namespace internal {
+/**
+ * @brief a piece of transfer contiguous on both VH and VE
+ */
+struct IoPiece {
+  char *host;
+  uint64_t ve;
+  size_t len;
+};
+
+/**
+ * @brief maximum gap between VE pieces read by one DMA
+ *
+ * Reading a gap is cheaper than one more DMA.
+ */
+constexpr size_t max_read_gap = 4096;
+
+/**
+ * @brief pieces of this size or larger are transferred directly
+ *
+ * Copying a large piece into the staging buffer costs more than the DMA
+ * it saves.
+ */
+constexpr size_t max_packed_piece = 64 * 1024;
+
+/**
+ * @brief maximum size of a run packed into the staging buffer
+ */
+constexpr size_t max_staging_size = 1024 * 1024;
+
+/**
+ * @brief split a pair of I/O vectors into pieces
+ */
+std::vector<IoPiece> split_iov(const struct iovec *hiov, int hcnt,
+                               const struct veo_iovec *viov, int vcnt)
+{
+  std::vector<IoPiece> pieces;
+  int h = 0, v = 0;
+  size_t hoff = 0, voff = 0;
+  for (;;) {
+    while (h < hcnt && hoff == hiov[h].iov_len) {
+      ++h;
+      hoff = 0;
+    }
+    while (v < vcnt && voff == viov[v].len) {
+      ++v;
+      voff = 0;
+    }
+    if (h == hcnt || v == vcnt)
+      break;
+    auto len = std::min(hiov[h].iov_len - hoff, viov[v].len - voff);
+    pieces.push_back({static_cast<char *>(hiov[h].iov_base) + hoff,
+                      viov[v].addr + voff, len});
+    hoff += len;
+    voff += len;
+  }
+  if (h != hcnt || v != vcnt) {
+    throw VEOException("total lengths of I/O vectors differ", EINVAL);
+  }
+  return pieces;
+}
+
+/**
+ * @brief the end of a run of pieces transferred by one DMA
+ *
+ * @param pieces pieces
+ * @param i the first piece of the run
+ * @param read true on read; gaps on VE are allowed.
+ *
+ * Only pieces smaller than max_packed_piece are packed, up to
+ * max_staging_size in total.
+ */
+size_t run_end(const std::vector<IoPiece> &pieces, size_t i, bool read)
+{
+  if (pieces[i].len >= max_packed_piece)
+    return i + 1;
+  auto start = pieces[i].ve;
+  auto end = start + pieces[i].len;
+  size_t j = i + 1;
+  for (; j < pieces.size(); ++j) {
+    auto ve = pieces[j].ve;
+    if (pieces[j].len >= max_packed_piece || ve < end
+        || (read ? ve - end > max_read_gap : ve != end)
+        || ve + pieces[j].len - start > max_staging_size)
+      break;
+    end = ve + pieces[j].len;
+  }
+  return j;
+}
+} // namespace internal
+
+/**
+ * @brief transfer data between host and VE I/O vectors
+ *
+ * @param hiov host I/O vector
+ * @param hcnt the number of elements of hiov
+ * @param viov VE I/O vector
+ * @param vcnt the number of elements of viov
+ * @param read true to read from VE; false to write to VE.
+ * @return zero upon success; negative upon failure
+ *
+ * The data are transferred as a single command. Small pieces contiguous
+ * on VE are packed into a staging buffer and transferred by one DMA; on
+ * read, small gaps between pieces are read together. Large pieces, and
+ * on write pieces with a gap between them on VE, are transferred one by
+ * one.
+ */
+int ProcHandle::transferIov(const struct iovec *hiov, int hcnt,
+                            const struct veo_iovec *viov, int vcnt,
+                            bool read)
+{
+  if (hcnt < 0 || vcnt < 0) {
+    throw VEOException("invalid I/O vector", EINVAL);
+  }
+  auto pieces = internal::split_iov(hiov, hcnt, viov, vcnt);
+  auto ctx = this->memWorker();
+  auto f = [ctx, &pieces, read] (Command *cmd) {
+    std::vector<char> staging;
+    int rv = 0;
+    for (size_t i = 0; i < pieces.size() && rv == 0; ) {
+      auto j = internal::run_end(pieces, i, read);
+      auto &first = pieces[i];
+      if (j == i + 1) {
+        rv = read ? ctx->_readMem(first.host, first.ve, first.len)
+                  : ctx->_writeMem(first.ve, first.host, first.len);
+        i = j;
+        continue;
+      }
+      auto base = first.ve;
+      staging.resize(pieces[j - 1].ve + pieces[j - 1].len - base);
+      if (read) {
+        rv = ve_recv_data(ctx->os_handle, base, staging.size(),
+                          staging.data());
+        for (auto k = i; k < j && rv == 0; ++k)
+          memcpy(pieces[k].host, &staging[pieces[k].ve - base],
+                 pieces[k].len);
+      } else {
+        for (auto k = i; k < j; ++k)
+          memcpy(&staging[pieces[k].ve - base], pieces[k].host,
+                 pieces[k].len);
+        rv = ve_send_data(ctx->os_handle, base, staging.size(),
+                          staging.data());
+      }
+      i = j;
+    }
+    cmd->setResult(rv, rv == 0 ? VEO_COMMAND_OK : VEO_COMMAND_ERROR);
+    return 0;
+  };
+  auto id = ctx->issueRequestID();
+  ctx->comq.pushRequest(std::unique_ptr<Command>(
+    new internal::CommandImpl(id, f)));
+  uint64_t ret;
+  ctx->callWaitResult(id, &ret);
+  return static_cast<int>(ret);
+}
+
+/**
+ * @brief transfer a 2D block between VH and VE
+ *
+ * @param host start of the block on VH
+ * @param hpitch distance between rows on VH in byte
+ * @param ve start of the block on VE
+ * @param vpitch distance between rows on VE in byte
+ * @param width width of the block in byte
+ * @param height the number of rows
+ * @param read true to read from VE; false to write to VE.
+ * @return zero upon success; negative upon failure
+ */
+int ProcHandle::transfer2D(void *host, size_t hpitch, uint64_t ve,
+                           size_t vpitch, size_t width, size_t height,
+                           bool read)
+{
+  if (width > hpitch || width > vpitch) {
+    throw VEOException("width is larger than pitch", EINVAL);
+  }
+  if (height > INT_MAX) {
+    throw VEOException("too many rows", EINVAL);
+  }
+  std::vector<struct iovec> hiov(height);
+  std::vector<struct veo_iovec> viov(height);
+  for (size_t i = 0; i < height; ++i) {
+    hiov[i].iov_base = static_cast<char *>(host) + i * hpitch;
+    hiov[i].iov_len = width;
+    viov[i].addr = ve + i * vpitch;
+    viov[i].len = width;
+  }
+  return this->transferIov(hiov.data(), height, viov.data(), height, read);
+}
+} // namespace veo
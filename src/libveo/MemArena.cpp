@@ -0,0 +1,334 @@
+/**
+ * @file MemArena.cpp
+ * @brief implementation of MemArena
+ */
+#include <algorithm>
+#include "MemArena.hpp"
+#include "VEOException.hpp"
+#include "log.hpp"
+
+namespace veo {
+namespace internal {
+std::atomic<uint64_t> next_arena_id(1);
+std::mutex arena_registry_mtx;//!< acquire before the mutex of an arena
+std::unordered_map<uint64_t, MemArena *> arena_registry;//!< live arenas
+
+/**
+ * @brief caches of a thread for arenas
+ *
+ * Blocks cached are returned to the arenas on exit of the thread.
+ */
+struct ThreadCaches {
+  std::unordered_map<uint64_t, MemArena::Cache> caches;//!< arena ID -> cache
+  ~ThreadCaches() {
+    std::lock_guard<std::mutex> lock(arena_registry_mtx);
+    for (auto &c: this->caches) {
+      auto itr = arena_registry.find(c.first);
+      if (itr != arena_registry.end())
+        itr->second->flush(c.second);
+    }
+  }
+};
+thread_local ThreadCaches thread_caches;
+
+/**
+ * @brief size class of an allocation
+ * @return size class; -1 if larger than the largest class.
+ */
+int size_class(size_t size)
+{
+  int shift = MemArena::min_shift;
+  while ((1UL << shift) < size) {
+    if (++shift > MemArena::max_shift)
+      return -1;
+  }
+  return shift - MemArena::min_shift;
+}
+
+size_t class_size(int cls)
+{
+  return 1UL << (cls + MemArena::min_shift);
+}
+
+/**
+ * @brief the maximum number of blocks of a class cached by a thread
+ */
+size_t cache_limit(int cls)
+{
+  size_t n = (256UL << 10) / class_size(cls);
+  return n < 2 ? 2 : n;
+}
+} // namespace internal
+
+/**
+ * @brief constructor
+ *
+ * @param s VEMVA of the slab
+ * @param c size class of blocks
+ */
+MemArena::Slab::Slab(uint64_t s, int c): start(s), cls(c)
+{
+  auto nblocks = (1UL << slab_shift) / internal::class_size(c);
+  auto nwords = (nblocks + 63) / 64;
+  this->used.reset(new std::atomic<uint64_t>[nwords]);
+  for (size_t i = 0; i < nwords; ++i)
+    this->used[i] = 0;
+}
+
+/**
+ * @brief mark a block allocated or free
+ *
+ * @param addr VEMVA of the block
+ * @param u true if allocated
+ * @return true if the block was allocated before.
+ */
+bool MemArena::Slab::setUsed(uint64_t addr, bool u)
+{
+  auto n = (addr - this->start) >> (this->cls + min_shift);
+  uint64_t mask = 1UL << (n % 64);
+  auto &word = this->used[n / 64];
+  auto prev = u ? word.fetch_or(mask) : word.fetch_and(~mask);
+  return (prev & mask) != 0;
+}
+
+/**
+ * @brief constructor
+ *
+ * @param a function to allocate a region on VE
+ * @param f function to free a region on VE
+ */
+MemArena::MemArena(AllocFunc a, FreeFunc f): alloc_raw(a), free_raw(f),
+  next_slab(0), end_slab(0), free_blocks(num_classes), region_bytes(0),
+  slab_bytes(0), large_bytes(0), used_bytes(0)
+{
+  std::lock_guard<std::mutex> lock(internal::arena_registry_mtx);
+  this->id = internal::next_arena_id++;
+  internal::arena_registry[this->id] = this;
+}
+
+/**
+ * @brief destructor
+ *
+ * VE memory is not freed since the VE process has exited.
+ */
+MemArena::~MemArena()
+{
+  std::lock_guard<std::mutex> lock(internal::arena_registry_mtx);
+  internal::arena_registry.erase(this->id);
+}
+
+/**
+ * @brief the cache of the calling thread for this arena
+ *
+ * Caches of the thread for arenas reset or destroyed are dropped when a
+ * new cache is created.
+ */
+MemArena::Cache &MemArena::threadCache()
+{
+  uint64_t id = this->id;
+  auto &caches = internal::thread_caches.caches;
+  auto itr = caches.find(id);
+  if (itr != caches.end())
+    return itr->second;
+  {
+    std::lock_guard<std::mutex> lock(internal::arena_registry_mtx);
+    for (auto c = caches.begin(); c != caches.end(); ) {
+      if (internal::arena_registry.find(c->first) ==
+          internal::arena_registry.end())
+        c = caches.erase(c);
+      else
+        ++c;
+    }
+  }
+  auto &c = caches[id];
+  c.resize(num_classes);
+  return c;
+}
+
+/**
+ * @brief carve a new slab for a size class
+ *
+ * Called with mtx held. A new region is allocated on VE if the current
+ * region is used up.
+ */
+void MemArena::newSlab(int cls)
+{
+  const uint64_t slab = 1UL << slab_shift;
+  if (this->next_slab == this->end_slab) {
+    // allocate one more slab to align slabs.
+    auto size = region_size + slab;
+    auto region = this->alloc_raw(size);
+    if (region == 0) {
+      throw VEOException("failed to allocate VE memory region", ENOMEM);
+    }
+    this->regions.push_back(region);
+    this->region_bytes += size;
+    this->next_slab = (region + slab - 1) & ~(slab - 1);
+    this->end_slab = this->next_slab + region_size;
+    VEO_DEBUG(nullptr, "arena %p: region %#lx (%lu bytes)", this, region,
+              size);
+  }
+  auto start = this->next_slab;
+  this->next_slab += slab;
+  this->slab_bytes += slab;
+  auto s = new Slab(start, cls);
+  this->slabs[start >> slab_shift].reset(s);
+  auto bsize = internal::class_size(cls);
+  auto &list = this->free_blocks[cls];
+  for (auto b = start + slab; b > start; b -= bsize)
+    list.push_back(Block{b - bsize, s});// lower addresses are popped first.
+}
+
+/**
+ * @brief move free blocks of a class to the cache of a thread
+ */
+void MemArena::refill(int cls, std::vector<Block> &cache)
+{
+  std::lock_guard<std::mutex> lock(this->mtx);
+  auto &list = this->free_blocks[cls];
+  if (list.empty())
+    this->newSlab(cls);
+  auto n = std::min(list.size(), internal::cache_limit(cls) / 2 + 1);
+  cache.insert(cache.end(), list.end() - n, list.end());
+  list.resize(list.size() - n);
+}
+
+/**
+ * @brief allocate VE memory
+ *
+ * @param size size in byte
+ * @return VEMVA of the memory allocated
+ */
+uint64_t MemArena::alloc(size_t size)
+{
+  auto cls = internal::size_class(size);
+  if (cls < 0) {
+    auto addr = this->alloc_raw(size);
+    if (addr != 0) {
+      std::lock_guard<std::mutex> lock(this->mtx);
+      this->large[addr] = size;
+      this->large_bytes += size;
+    }
+    return addr;
+  }
+  auto &cache = this->threadCache()[cls];
+  if (cache.empty())
+    this->refill(cls, cache);
+  auto b = cache.back();
+  cache.pop_back();
+  b.slab->setUsed(b.addr, true);
+  this->used_bytes += internal::class_size(cls);
+  return b.addr;
+}
+
+/**
+ * @brief free VE memory allocated from this arena
+ *
+ * @param addr VEMVA of the memory
+ * @return true if freed; false if addr is not in this arena.
+ *
+ * Memory in a slab not allocated, freed twice or pointed to inside a
+ * block is rejected with EINVAL.
+ */
+bool MemArena::free(uint64_t addr)
+{
+  Slab *slab = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(this->mtx);
+    auto itr = this->slabs.find(addr >> slab_shift);
+    if (itr == this->slabs.end()) {
+      auto l = this->large.find(addr);
+      if (l == this->large.end())
+        return false;
+      this->large_bytes -= l->second;
+      this->large.erase(l);
+    } else {
+      slab = itr->second.get();
+      if ((addr - slab->start) & (internal::class_size(slab->cls) - 1)) {
+        throw VEOException("VE memory not at the start of a block", EINVAL);
+      }
+      if (!slab->setUsed(addr, false)) {
+        throw VEOException("VE memory not allocated or freed twice",
+                           EINVAL);
+      }
+    }
+  }
+  if (slab == nullptr) {
+    this->free_raw(addr);
+    return true;
+  }
+  auto cls = slab->cls;
+  this->used_bytes -= internal::class_size(cls);
+  auto &cache = this->threadCache()[cls];
+  cache.push_back(Block{addr, slab});
+  auto limit = internal::cache_limit(cls);
+  if (cache.size() > limit) {
+    std::lock_guard<std::mutex> lock(this->mtx);
+    auto &list = this->free_blocks[cls];
+    list.insert(list.end(), cache.begin() + limit / 2, cache.end());
+    cache.resize(limit / 2);
+  }
+  return true;
+}
+
+/**
+ * @brief return blocks in a cache of a thread to this arena
+ */
+void MemArena::flush(Cache &cache)
+{
+  std::lock_guard<std::mutex> lock(this->mtx);
+  for (size_t i = 0; i < cache.size(); ++i) {
+    auto &list = this->free_blocks[i];
+    list.insert(list.end(), cache[i].begin(), cache[i].end());
+    cache[i].clear();
+  }
+}
+
+/**
+ * @brief free all VE memory in this arena
+ *
+ * Caches of threads for this arena are abandoned by changing the ID.
+ */
+void MemArena::reset()
+{
+  {
+    std::lock_guard<std::mutex> lock(internal::arena_registry_mtx);
+    internal::arena_registry.erase(this->id);
+    this->id = internal::next_arena_id++;
+    internal::arena_registry[this->id] = this;
+  }
+  std::lock_guard<std::mutex> lock(this->mtx);
+  VEO_TRACE(nullptr, "arena %p: reset %lu regions, %lu large blocks",
+            this, this->regions.size(), this->large.size());
+  for (auto region: this->regions)
+    this->free_raw(region);
+  for (auto &l: this->large)
+    this->free_raw(l.first);
+  this->regions.clear();
+  this->large.clear();
+  this->slabs.clear();
+  for (auto &list: this->free_blocks)
+    list.clear();
+  this->next_slab = this->end_slab = 0;
+  this->region_bytes = this->slab_bytes = this->large_bytes = 0;
+  this->used_bytes = 0;
+}
+
+/**
+ * @brief get usage of this arena
+ *
+ * @param[out] stats statistics
+ */
+void MemArena::getStats(veo_mem_stats *stats)
+{
+  std::lock_guard<std::mutex> lock(this->mtx);
+  stats->regions = this->regions.size();
+  stats->region_bytes = this->region_bytes;
+  stats->slab_bytes = this->slab_bytes;
+  stats->used_bytes = this->used_bytes;
+  stats->large_blocks = this->large.size();
+  stats->large_bytes = this->large_bytes;
+  stats->fragmentation = this->slab_bytes > 0 ?
+    1.0 - static_cast<double>(this->used_bytes) / this->slab_bytes : 0.0;
+}
+} // namespace veo
@@ -0,0 +1,87 @@
+/**
+ * @file MemArena.hpp
+ * @brief suballocator of VE memory managed on VH
+ */
+#ifndef _VEO_MEM_ARENA_HPP_
+#define _VEO_MEM_ARENA_HPP_
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <ve_offload.h>
+
+namespace veo {
+/**
+ * @brief arena of VE memory
+ *
+ * Large regions are allocated on VE and split into slabs, each of which
+ * holds blocks of a size class, power of two. Allocations are served
+ * from the cache of the calling thread, refilled from the free lists of
+ * the arena in batches; only allocations larger than the largest class
+ * and new regions call functions on VE.
+ */
+class MemArena {
+public:
+  typedef std::function<uint64_t(size_t)> AllocFunc;
+  typedef std::function<void(uint64_t)> FreeFunc;
+  /**
+   * @brief a slab holding blocks of a size class
+   */
+  struct Slab {
+    uint64_t start;
+    int cls;
+    std::unique_ptr<std::atomic<uint64_t>[]> used;//!< bitmap of blocks
+    Slab(uint64_t, int);
+    bool setUsed(uint64_t, bool);
+  };
+  /**
+   * @brief a free block
+   */
+  struct Block {
+    uint64_t addr;
+    Slab *slab;
+  };
+  typedef std::vector<std::vector<Block> > Cache;//!< blocks per class
+
+  static constexpr int min_shift = 6;//!< 64 bytes
+  static constexpr int max_shift = 18;//!< 256 KiB
+  static constexpr int num_classes = max_shift - min_shift + 1;
+  static constexpr int slab_shift = 20;//!< 1 MiB
+  static constexpr size_t region_size = 64UL << 20;
+private:
+  AllocFunc alloc_raw;
+  FreeFunc free_raw;
+  std::mutex mtx;
+  std::atomic<uint64_t> id;//!< identifies caches of threads for this arena
+  std::vector<uint64_t> regions;
+  uint64_t next_slab;//!< next slab in the current region
+  uint64_t end_slab;
+  //! slab number -> slab
+  std::unordered_map<uint64_t, std::unique_ptr<Slab> > slabs;
+  Cache free_blocks;
+  std::unordered_map<uint64_t, size_t> large;//!< VEMVA -> size
+  uint64_t region_bytes;
+  uint64_t slab_bytes;
+  uint64_t large_bytes;
+  std::atomic<uint64_t> used_bytes;
+
+  Cache &threadCache();
+  void refill(int, std::vector<Block> &);
+  void newSlab(int);
+public:
+  MemArena(AllocFunc, FreeFunc);
+  ~MemArena();
+  MemArena(const MemArena &) = delete;
+
+  uint64_t alloc(size_t);
+  bool free(uint64_t);
+  void flush(Cache &);
+  void reset();
+  void getStats(veo_mem_stats *);
+};
+} // namespace veo
+#endif
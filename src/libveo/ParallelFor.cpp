@@ -0,0 +1,190 @@
+/**
+ * @file ParallelFor.cpp
+ * @brief implementation of parallel for loop on a context group
+ */
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "CallArgs.hpp"
+#include "ContextGroup.hpp"
+#include "ProcHandle.hpp"
+#include "ThreadContext.hpp"
+#include "VEOException.hpp"
+#include "log.hpp"
+
+namespace veo {
+namespace internal {
+/**
+ * @brief a chunk of the index range in flight on a context
+ */
+struct ForSlot {
+  std::vector<uint64_t> vebufs;//!< VE buffers, one for each host buffer
+  CallArgs args;
+  uint64_t reqid;
+  size_t begin;
+  size_t len;
+  bool busy;
+  ForSlot(): reqid(VEO_REQUEST_ID_INVALID), begin(0), len(0), busy(false) {}
+};
+
+/**
+ * @brief state of a parallel for loop shared by contexts
+ */
+struct ForLoop {
+  ProcHandle *proc;
+  uint64_t addr;
+  size_t begin;//!< the first index, at the start of the host buffers
+  size_t end;
+  size_t grain;
+  const veo_pfor_buf *bufs;
+  int nbufs;
+  std::atomic<size_t> next;//!< the first index not assigned yet
+  std::atomic<bool> failed;
+};
+
+bool is_in(const veo_pfor_buf &b)
+{
+  return b.intent == VEO_INTENT_IN || b.intent == VEO_INTENT_INOUT;
+}
+
+bool is_out(const veo_pfor_buf &b)
+{
+  return b.intent == VEO_INTENT_OUT || b.intent == VEO_INTENT_INOUT;
+}
+
+/**
+ * @brief wait for the call of a chunk and download the outputs
+ */
+void finish_slot(ForLoop &loop, ThreadContext *ctx, ForSlot &slot)
+{
+  if (!slot.busy)
+    return;
+  slot.busy = false;
+  uint64_t ret;
+  int rv = ctx->callWaitResult(slot.reqid, &ret);
+  if (rv != VEO_COMMAND_OK || ret != 0) {
+    VEO_ERROR(ctx, "chunk [%lu, %lu) failed (%d, %lu)", slot.begin,
+              slot.begin + slot.len, rv, ret);
+    loop.failed = true;
+    return;
+  }
+  for (int i = 0; i < loop.nbufs; ++i) {
+    const auto &b = loop.bufs[i];
+    if (!is_out(b))
+      continue;
+    auto host = static_cast<char *>(b.host)
+                + (slot.begin - loop.begin) * b.elem_size;
+    if (loop.proc->readMem(host, slot.vebufs[i], slot.len * b.elem_size)
+        != 0) {
+      loop.failed = true;
+      return;
+    }
+  }
+}
+
+/**
+ * @brief run chunks of a parallel for loop on a context
+ *
+ * Two chunks are in flight on each context: the inputs of a chunk are
+ * uploaded and the outputs of the previous chunk on the slot are
+ * downloaded while the other chunk is running on VE.
+ */
+void run_for_loop(ForLoop &loop, ThreadContext *ctx)
+{
+  ForSlot slots[2];
+  int cur = 0;
+  try {
+    for (auto &slot: slots) {
+      for (int i = 0; i < loop.nbufs; ++i) {
+        auto size = loop.grain * loop.bufs[i].elem_size;
+        auto buf = loop.proc->allocBuff(size);
+        if (buf == 0)
+          throw VEOException("failed to allocate VE buffer", ENOMEM);
+        slot.vebufs.push_back(buf);
+      }
+    }
+    while (!loop.failed) {
+      auto begin = loop.next.fetch_add(loop.grain);
+      if (begin >= loop.end)
+        break;
+      auto &slot = slots[cur];
+      cur ^= 1;
+      finish_slot(loop, ctx, slot);
+      slot.begin = begin;
+      slot.len = std::min(loop.grain, loop.end - begin);
+      for (int i = 0; i < loop.nbufs; ++i) {
+        const auto &b = loop.bufs[i];
+        if (!is_in(b))
+          continue;
+        auto host = static_cast<char *>(b.host)
+                    + (begin - loop.begin) * b.elem_size;
+        if (loop.proc->writeMem(slot.vebufs[i], host, slot.len * b.elem_size)
+            != 0)
+          throw VEOException("failed to upload a chunk", EIO);
+      }
+      slot.args.clear();
+      slot.args.set(0, static_cast<uint64_t>(slot.begin));
+      slot.args.set(1, static_cast<uint64_t>(slot.len));
+      for (int i = 0; i < loop.nbufs; ++i)
+        slot.args.set(2 + i, slot.vebufs[i]);
+      slot.reqid = ctx->callAsync(loop.addr, slot.args);
+      slot.busy = true;
+    }
+  } catch (VEOException &e) {
+    VEO_ERROR(ctx, "parallel for failed: %s", e.what());
+    loop.failed = true;
+  }
+  for (auto &slot: slots) {
+    finish_slot(loop, ctx, slot);
+    for (auto buf: slot.vebufs)
+      loop.proc->freeBuff(buf);
+  }
+}
+} // namespace internal
+
+/**
+ * @brief run a function over an index range on all contexts
+ *
+ * @param addr VEMVA of the function
+ * @param begin the first index
+ * @param end the last index + 1
+ * @param grain the number of indices in a chunk
+ * @param bufs host buffers indexed by the range; the element of index
+ *        begin is at the start of each buffer.
+ * @param nbufs the number of host buffers
+ * @return zero upon success; -1 if a chunk failed.
+ *
+ * The range is split into chunks of grain indices, assigned to contexts
+ * on demand. For each chunk, the parts of IN buffers are uploaded to VE
+ * buffers, the function is called as
+ * func(chunk_begin, chunk_len, vebuf_0, vebuf_1, ...), and the parts of
+ * OUT buffers are downloaded. The function returns zero upon success.
+ */
+int ContextGroup::parallelFor(uint64_t addr, size_t begin, size_t end,
+                              size_t grain, const veo_pfor_buf *bufs,
+                              int nbufs)
+{
+  if (grain == 0 || nbufs < 0 || nbufs + 2 > VEO_MAX_NUM_ARGS) {
+    throw VEOException("invalid parallel for parameters", EINVAL);
+  }
+  if (begin >= end)
+    return 0;
+  internal::ForLoop loop;
+  loop.proc = this->proc;
+  loop.addr = addr;
+  loop.begin = begin;
+  loop.end = end;
+  loop.grain = grain;
+  loop.bufs = bufs;
+  loop.nbufs = nbufs;
+  loop.next = begin;
+  loop.failed = false;
+
+  std::vector<std::thread> drivers;
+  for (auto ctx: this->contexts)
+    drivers.emplace_back(internal::run_for_loop, std::ref(loop), ctx);
+  for (auto &t: drivers)
+    t.join();
+  return loop.failed ? -1 : 0;
+}
+} // namespace veo
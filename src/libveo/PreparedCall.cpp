@@ -0,0 +1,100 @@
+/**
+ * @file PreparedCall.cpp
+ * @brief implementation of PreparedCall
+ */
+#include <cstring>
+#include "PreparedCall.hpp"
+#include "CallArgs.hpp"
+#include "ThreadContext.hpp"
+#include "VEOException.hpp"
+#include "log.hpp"
+
+namespace veo {
+/**
+ * @brief constructor
+ *
+ * @param c VEO context to call the function on
+ * @param a VEMVA of the function
+ * @param sig signature of the function
+ */
+PreparedCall::PreparedCall(ThreadContext *c, uint64_t a, const char *sig):
+  ctx(c), addr(a), signature(sig != nullptr ? sig : "")
+{
+  if (a == 0) {
+    throw VEOException("invalid function address", EINVAL);
+  }
+  if (this->signature.size() > VEO_MAX_NUM_ARGS) {
+    throw VEOException("too many arguments", EINVAL);
+  }
+  auto bad = this->signature.find_first_not_of("lLiIdf");
+  if (bad != std::string::npos) {
+    VEO_ERROR(nullptr, "unknown type '%c' in signature", this->signature[bad]);
+    throw VEOException("invalid signature", EINVAL);
+  }
+  this->slots.fill(0);
+  this->stack_size = PARAM_AREA_OFFSET + 8 * this->signature.size();
+}
+
+/**
+ * @brief check the type of an argument
+ *
+ * @param argnum argument number
+ * @param types characters in signature accepted
+ */
+void PreparedCall::check(int argnum, const char *types) const
+{
+  if (argnum < 0 || argnum >= this->numArgs()) {
+    throw VEOException("argument number out of range", EINVAL);
+  }
+  if (std::strchr(types, this->signature[argnum]) == nullptr) {
+    throw VEOException("argument type mismatch", EINVAL);
+  }
+}
+
+void PreparedCall::setI64(int argnum, int64_t val)
+{
+  this->check(argnum, "lL");
+  this->slots[argnum] = internal::reg_value(val);
+}
+
+void PreparedCall::setU64(int argnum, uint64_t val)
+{
+  this->check(argnum, "lL");
+  this->slots[argnum] = internal::reg_value(val);
+}
+
+void PreparedCall::setI32(int argnum, int32_t val)
+{
+  this->check(argnum, "iI");
+  this->slots[argnum] = internal::reg_value(val);
+}
+
+void PreparedCall::setU32(int argnum, uint32_t val)
+{
+  this->check(argnum, "iI");
+  this->slots[argnum] = internal::reg_value(val);
+}
+
+void PreparedCall::setDouble(int argnum, double val)
+{
+  this->check(argnum, "d");
+  this->slots[argnum] = internal::reg_value(val);
+}
+
+void PreparedCall::setFloat(int argnum, float val)
+{
+  this->check(argnum, "f");
+  this->slots[argnum] = internal::reg_value(val);
+}
+
+/**
+ * @brief launch the call with the arguments currently set
+ *
+ * @return request ID
+ */
+uint64_t PreparedCall::launch()
+{
+  return this->ctx->callPrepared(this->addr, this->slots, this->numArgs(),
+                                 this->stack_size);
+}
+} // namespace veo
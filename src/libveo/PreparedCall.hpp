@@ -0,0 +1,55 @@
+/**
+ * @file PreparedCall.hpp
+ * @brief VE function call prepared for repeated launches
+ */
+#ifndef _VEO_PREPARED_CALL_HPP_
+#define _VEO_PREPARED_CALL_HPP_
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include <ve_offload.h>
+
+namespace veo {
+class ThreadContext;
+
+/**
+ * @brief a call of a VE function with a fixed signature
+ *
+ * The signature is a string with a character for each argument:
+ * 'l' int64_t, 'L' uint64_t, 'i' int32_t, 'I' uint32_t, 'd' double and
+ * 'f' float. The register and stack layout is computed once on
+ * preparation; setting an argument stores its register value in a slot
+ * and a launch copies the slots into the command, so that the arguments
+ * can be set for the next launch immediately.
+ */
+class PreparedCall {
+public:
+  typedef std::array<uint64_t, VEO_MAX_NUM_ARGS> Slots;
+private:
+  ThreadContext *ctx;
+  uint64_t addr;
+  std::string signature;
+  Slots slots;//!< values of arguments as set to registers
+  size_t stack_size;//!< size of stack frame for the arguments
+
+  void check(int, const char *) const;
+public:
+  PreparedCall(ThreadContext *, uint64_t, const char *);
+  PreparedCall(const PreparedCall &) = delete;
+
+  int numArgs() const { return this->signature.size(); }
+  void setI64(int, int64_t);
+  void setU64(int, uint64_t);
+  void setI32(int, int32_t);
+  void setU32(int, uint32_t);
+  void setDouble(int, double);
+  void setFloat(int, float);
+  uint64_t launch();
+
+  veo_prepared_call *toCHandle() {
+    return reinterpret_cast<veo_prepared_call *>(this);
+  }
+};
+} // namespace veo
+#endif
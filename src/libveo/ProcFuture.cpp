@@ -0,0 +1,102 @@
+/**
+ * @file ProcFuture.cpp
+ * @brief implementation of ProcFuture
+ */
+#include <memory>
+#include <string>
+#include "ProcFuture.hpp"
+#include "ProcHandle.hpp"
+#include "VEOException.hpp"
+#include "log.hpp"
+
+namespace veo {
+namespace internal {
+/**
+ * @brief create a VE process and keep the thread until the process exits
+ *
+ * @param ossock path to VE OS socket
+ * @param vedev path to VE device file
+ * @param binname VE executable
+ * @param promise promise to set the VE process created
+ */
+void create_proc(std::string ossock, std::string vedev, std::string binname,
+                 std::shared_ptr<std::promise<ProcHandle *> > promise)
+{
+  ProcHandle *proc;
+  try {
+    proc = new ProcHandle(ossock.c_str(), vedev.c_str(), binname.c_str());
+  } catch (...) {
+    promise->set_exception(std::current_exception());
+    return;
+  }
+  promise->set_value(proc);
+  proc->parkHomeThread();
+}
+} // namespace internal
+
+/**
+ * @brief constructor
+ *
+ * @param ossock path to VE OS socket
+ * @param vedev path to VE device file
+ * @param binname VE executable
+ *
+ * The creation of the VE process starts immediately.
+ */
+ProcFuture::ProcFuture(const char *ossock, const char *vedev,
+                       const char *binname)
+{
+  std::shared_ptr<std::promise<ProcHandle *> > promise(
+    new std::promise<ProcHandle *>());
+  this->result = promise->get_future();
+  try {
+    this->home = std::thread(internal::create_proc, std::string(ossock),
+                             std::string(vedev), std::string(binname),
+                             promise);
+  } catch (std::system_error &e) {
+    throw VEOException("failed to start process creation", e.code().value());
+  }
+}
+
+/**
+ * @brief destructor
+ *
+ * A VE process created but not taken by get() is terminated.
+ */
+ProcFuture::~ProcFuture()
+{
+  if (!this->result.valid())
+    return;
+  try {
+    auto proc = this->get();
+    VEO_DEBUG(nullptr, "terminating process %p not taken", proc);
+    proc->exitProc();
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "process creation failed: %s", e.what());
+  } catch (...) {
+    // exceptions from create_proc() other than VEOException
+    VEO_ERROR(nullptr, "process creation failed: %s", "unknown exception");
+  }
+}
+
+/**
+ * @brief wait for the creation of the VE process
+ *
+ * @return the VE process created, which owns the thread created it.
+ */
+ProcHandle *ProcFuture::get()
+{
+  if (!this->result.valid()) {
+    throw VEOException("the process has already been taken", EINVAL);
+  }
+  ProcHandle *proc;
+  try {
+    proc = this->result.get();
+  } catch (...) {
+    this->home.join();
+    throw;
+  }
+  proc->adoptHomeThread(std::move(this->home));
+  return proc;
+}
+} // namespace veo
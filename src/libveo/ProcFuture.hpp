@@ -0,0 +1,38 @@
+/**
+ * @file ProcFuture.hpp
+ * @brief VE process being created asynchronously
+ */
+#ifndef _VEO_PROC_FUTURE_HPP_
+#define _VEO_PROC_FUTURE_HPP_
+#include <future>
+#include <thread>
+
+#include <ve_offload.h>
+
+namespace veo {
+class ProcHandle;
+
+/**
+ * @brief future of a VE process
+ *
+ * The VE process is created on a separate host thread; get() waits for
+ * the completion and returns the process or throws the exception raised
+ * on creation. The thread stays with the process created until it exits.
+ */
+class ProcFuture {
+private:
+  std::thread home;//!< thread creating the process
+  std::future<ProcHandle *> result;
+public:
+  ProcFuture(const char *, const char *, const char *);
+  ~ProcFuture();
+  ProcFuture(const ProcFuture &) = delete;
+
+  ProcHandle *get();
+
+  veo_proc_future *toCHandle() {
+    return reinterpret_cast<veo_proc_future *>(this);
+  }
+};
+} // namespace veo
+#endif
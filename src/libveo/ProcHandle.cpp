@@ -8,7 +8,14 @@
 #include "CallArgs.hpp"
 #include "log.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
 #include <string.h>
+#include <limits.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <sys/ipc.h>
 #include <sys/mman.h>
@@ -150,21 +157,15 @@ void init_rwlock_to_sync_dma_fork()
   }
 }
 
+namespace internal {
+constexpr int default_mem_workers = 4;//!< contexts for memory operations
+constexpr size_t default_stripe_chunk = 64UL << 20;
+std::once_flag pseudo_init_flag;
 /**
- * @brief create a VE process and initialize a thread context
- *
- * @param[in,out] ctx the thread context of the main thread
- * @param oshandle VE OS handle for the VE process (main thread)
- * @param binname VE executable
+ * @brief initialize data in libvepseudo shared by all VE processes
  */
-int spawn_helper(ThreadContext *ctx, veos_handle *oshandle, const char *binname)
+void init_pseudo_once()
 {
-  /* necessary to allocate PATH_MAX because VE OS requests to
-   * transfer PATH_MAX. */
-  char helper_name[PATH_MAX];
-  strncpy(helper_name, binname, sizeof(helper_name));
-
-  int rv = -1;
   // libvepseudo touches PTRACE_PRIVATE_DATA area.
   void *ptrace_private = mmap((void *)PTRACE_PRIVATE_DATA, 4096,
                               PROT_READ|PROT_WRITE,
@@ -185,21 +186,51 @@ int spawn_helper(ThreadContext *ctx, veos_handle *oshandle, const char *binname)
   }
 
   memset(ptrace_private, 0, 4096);
-
-  // Set global TID array for main thread.
-  global_tid_info[0].vefd = oshandle->ve_handle->vefd;
-  global_tid_info[0].veos_hndl = oshandle;
-  tid_counter = 0;
-  global_tid_info[0].tid_val = syscall(SYS_gettid);// main thread
-  global_tid_info[0].flag = 0;
-  global_tid_info[0].mutex = PTHREAD_MUTEX_INITIALIZER;
-  global_tid_info[0].cond = PTHREAD_COND_INITIALIZER;
   init_rwlock_to_sync_dma_fork();
+}
+} // namespace internal
+
+/**
+ * @brief create a VE process and initialize a thread context
+ *
+ * @param[in,out] ctx the thread context of the main thread
+ * @param oshandle VE OS handle for the VE process (main thread)
+ * @param binname VE executable
+ * @param state the state of the VE process
+ * @param prof timings of phases
+ *
+ * The global variables in libvepseudo are switched to the VE process
+ * only while they are used; the communication with VE OS for other VE
+ * processes can run concurrently.
+ */
+int spawn_helper(ThreadContext *ctx, veos_handle *oshandle, const char *binname,
+                 ProcState *state, StartupProfile *prof)
+{
+  /* necessary to allocate PATH_MAX because VE OS requests to
+   * transfer PATH_MAX. */
+  char helper_name[PATH_MAX];
+  strncpy(helper_name, binname, sizeof(helper_name));
+
+  int rv = -1;
+  std::call_once(internal::pseudo_init_flag, internal::init_pseudo_once);
+
+  {
+    ProcStateGuard guard(state);
+    // Set global TID array for main thread.
+    global_tid_info[0].vefd = oshandle->ve_handle->vefd;
+    global_tid_info[0].veos_hndl = oshandle;
+    tid_counter = 0;
+    global_tid_info[0].tid_val = syscall(SYS_gettid);// main thread
+    global_tid_info[0].flag = 0;
+    // the mutex and the condition variable are initialized once and
+    // shared by VE processes; see vars.c.
+  }
   // Initialize the syscall argument area.
   rv = init_lhm_shm_area(oshandle);
   if (rv < 0) {
     throw VEOException("failed to create shared memory region.", 0);
   }
+  prof->mark(VEO_STARTUP_SHM);
   // Request VE OS to create a new VE process
   new_ve_proc ve_proc = {0};
   // TODO: set resource limit.
@@ -232,34 +263,40 @@ int spawn_helper(ThreadContext *ctx, veos_handle *oshandle, const char *binname)
   }
   VEO_DEBUG(ctx, "CORE ID: %d\t NODE ID: %d", core_id, node_id);
   vedl_set_syscall_area_offset(oshandle->ve_handle, 0);
+  prof->mark(VEO_STARTUP_NEW_PROC);
 
-  // initialize VEMVA space
-  INIT_LIST_HEAD(&vemva_header.vemva_list);
-  retval = init_vemva_header();
-  if (retval) {
-    VEO_ERROR(ctx, "failed to initialize (%d)", retval);
-    return retval;
-  }
-
-  // Load an executable
   struct ve_start_ve_req_cmd start_ve_req = {{0}};
-  retval = pse_load_binary(helper_name, oshandle, &start_ve_req);
-  if (retval) {
-    VEO_ERROR(ctx, "failed to load ve binary (%d)", retval);
-    process_thread_cleanup(oshandle, -1);
-    return retval;
-  }
+  {
+    ProcStateGuard guard(state);
+    // initialize VEMVA space
+    INIT_LIST_HEAD(&vemva_header.vemva_list);
+    retval = init_vemva_header();
+    if (retval) {
+      VEO_ERROR(ctx, "failed to initialize (%d)", retval);
+      return retval;
+    }
 
-  // initialize the stack
-  char *ve_argv[] = { helper_name, nullptr};
-  retval = init_stack_veo(oshandle, 1, ve_argv, environ, &start_ve_req);
-  if (retval) {
-    VEO_ERROR(ctx, "failed to make stack region (%d)", retval);
-    process_thread_cleanup(oshandle, -1);
-    return retval;
+    // Load an executable
+    retval = pse_load_binary(helper_name, oshandle, &start_ve_req);
+    if (retval) {
+      VEO_ERROR(ctx, "failed to load ve binary (%d)", retval);
+      process_thread_cleanup(oshandle, -1);
+      return retval;
+    }
+    prof->mark(VEO_STARTUP_LOAD_ELF);
+
+    // initialize the stack
+    char *ve_argv[] = { helper_name, nullptr};
+    retval = init_stack_veo(oshandle, 1, ve_argv, environ, &start_ve_req);
+    if (retval) {
+      VEO_ERROR(ctx, "failed to make stack region (%d)", retval);
+      process_thread_cleanup(oshandle, -1);
+      return retval;
+    }
+    memcpy(&start_ve_req.ve_info, &ve_info,
+      sizeof(struct ve_address_space_info_cmd));
   }
-  memcpy(&start_ve_req.ve_info, &ve_info,
-    sizeof(struct ve_address_space_info_cmd));
+  prof->mark(VEO_STARTUP_INIT_STACK);
 
   // start VE process
   retval = pseudo_psm_send_start_ve_proc_req(&start_ve_req,
@@ -273,6 +310,7 @@ int spawn_helper(ThreadContext *ctx, veos_handle *oshandle, const char *binname)
     VEO_ERROR(ctx, "Failed to receive START VE PROC ack (%d)", retval);
     return retval;
   }
+  prof->mark(VEO_STARTUP_START_PROC);
   VEO_TRACE(ctx, "%s: Succeed to create a VE process.", __func__);
   return 0;
 }
@@ -285,9 +323,13 @@ int spawn_helper(ThreadContext *ctx, veos_handle *oshandle, const char *binname)
  * @param binname VE executable
  */
 ProcHandle::ProcHandle(const char *ossock, const char *vedev,
-                       const char *binname)
+                       const char *binname):
+  stripe_chunk(internal::default_stripe_chunk), stripe_lanes(0),
+  exiting(false), closing(false)
 {
   int retval;
+  this->startup.start();
+  this->dispatcher.reset(new Dispatcher(this));
   // open VE OS handle
   veos_handle *os_handle = veos_handle_create(const_cast<char *>(vedev),
                              const_cast<char *>(ossock), nullptr, -1);
@@ -297,8 +339,10 @@ ProcHandle::ProcHandle(const char *ossock, const char *vedev,
   g_handle = os_handle;
   // initialize the main thread context
   this->main_thread.reset(new ThreadContext(this, os_handle, true));
+  this->startup.mark(VEO_STARTUP_OS_HANDLE);
 
-  if (spawn_helper(this->main_thread.get(), os_handle, binname) != 0) {
+  if (spawn_helper(this->main_thread.get(), os_handle, binname,
+                   &this->state, &this->startup) != 0) {
     veos_handle_free(os_handle);
     throw VEOException("The creation of a VE process failed.", 0);
   }
@@ -307,6 +351,7 @@ ProcHandle::ProcHandle(const char *ossock, const char *vedev,
 
   // handle some system calls from main thread for initialization of VE libc.
   this->waitForBlock();
+  this->startup.mark(VEO_STARTUP_LIBC_INIT);
   // VE process is to stop at the first block here.
   // sysve(VEO_BLOCK, &veo__helper_functions);
   uint64_t funcs_addr = this->main_thread->_collectReturnValue();
@@ -328,6 +373,7 @@ ProcHandle::ProcHandle(const char *ossock, const char *vedev,
   DEBUG_PRINT_HELPER(this->main_thread.get(), this->funcs, create_thread);
   DEBUG_PRINT_HELPER(this->main_thread.get(), this->funcs, call_func);
   DEBUG_PRINT_HELPER(this->main_thread.get(), this->funcs, exit);
+  this->startup.mark(VEO_STARTUP_HELPER_FETCH);
   // create worker
   CallArgs args_create_thread;
   this->main_thread->_doCall(this->funcs.create_thread, args_create_thread);
@@ -345,8 +391,25 @@ ProcHandle::ProcHandle(const char *ossock, const char *vedev,
   // restart execution; execute until the next block request.
   this->main_thread->_unBlock(tid);
   this->waitForBlock();
+  this->startup.mark(VEO_STARTUP_WORKER_CLONE);
 
   VEO_TRACE(this->worker.get(), "sp = %#lx", this->worker->ve_sp);
+
+  const char *arena_env = getenv("VEO_MEM_ARENA");
+  if (arena_env == nullptr || strcmp(arena_env, "0") != 0) {
+    using namespace std::placeholders;
+    this->arena.reset(new MemArena(
+      std::bind(&ProcHandle::allocRaw, this, _1),
+      std::bind(&ProcHandle::freeRaw, this, _1)));
+  }
+
+  const char *preload = getenv("VEO_PRELOAD_LIBS");
+  if (preload != nullptr) {
+    this->preloadLibraries(preload);
+  }
+  this->startup.mark(VEO_STARTUP_PRELOAD);
+  VEO_DEBUG(nullptr, "process %p created in %f sec", this,
+            this->startup.total());
 }
 
 uint64_t doOnContext(ThreadContext *ctx, uint64_t func, CallArgs &args)
@@ -362,11 +425,34 @@ uint64_t doOnContext(ThreadContext *ctx, uint64_t func, CallArgs &args)
   return ret;
 }
 
+namespace internal {
+/**
+ * @brief canonicalize a library name
+ *
+ * @param libname a library name
+ * @return the absolute path without symbolic links if libname is a path;
+ *         libname itself if it is a name searched by the dynamic linker
+ *         or the path does not exist on VH.
+ */
+std::string canonical_library_name(const char *libname)
+{
+  if (strchr(libname, '/') == nullptr)
+    return libname;
+  char path[PATH_MAX];
+  if (realpath(libname, path) == nullptr)
+    return libname;
+  return path;
+}
+} // namespace internal
+
 /**
  * @brief Load a VE library in VE process space
  *
  * @param libname a library name
  * @return handle of the library loaded upon success; zero upon failure.
+ *
+ * A library already loaded is not loaded again; the handle returned
+ * on the first load is returned.
  */
 uint64_t ProcHandle::loadLibrary(const char *libname)
 {
@@ -375,23 +461,137 @@ uint64_t ProcHandle::loadLibrary(const char *libname)
   if (len > VEO_SYMNAME_LEN_MAX) {
     throw VEOException("Too long name", ENAMETOOLONG);
   }
+  auto name = internal::canonical_library_name(libname);
+  {
+    std::lock_guard<std::mutex> lock(this->lib_mtx);
+    auto itr = this->lib_handle.find(name);
+    if (itr != this->lib_handle.end()) {
+      VEO_TRACE(this->worker.get(), "handle = %#lx (loaded)", itr->second);
+      return itr->second;
+    }
+  }
   CallArgs args;// no argument.
   args.setOnStack(VEO_INTENT_IN, 0, const_cast<char *>(libname), len + 1);
 
   uint64_t handle = doOnContext(this->worker.get(),
                                 this->funcs.load_library, args);
   VEO_TRACE(this->worker.get(), "handle = %#lx", handle);
+  if (handle != 0) {
+    this->readSymbolTable(handle, name.c_str());
+    std::lock_guard<std::mutex> lock(this->lib_mtx);
+    this->lib_handle.emplace(name, handle);
+  }
   return handle;
 }
 
 /**
- * @brief Find a symbol in VE program
+ * @brief Load libraries on creation of VE process
+ *
+ * @param liblist colon-separated list of library names
+ *
+ * Requests to load all libraries are put into the queue of the worker
+ * at once and the results are collected later. A library failed to load
+ * is reported but the creation of VE process continues.
+ */
+void ProcHandle::preloadLibraries(const char *liblist)
+{
+  std::vector<std::string> names;
+  std::string list(liblist);
+  size_t start = 0;
+  while (start <= list.size()) {
+    auto end = list.find(':', start);
+    if (end == std::string::npos)
+      end = list.size();
+    if (end > start)
+      names.push_back(list.substr(start, end - start));
+    start = end + 1;
+  }
+  // names are not modified from here; c_str() is valid until return.
+  std::vector<std::unique_ptr<CallArgs> > args;
+  std::vector<uint64_t> reqids;
+  for (auto &name: names) {
+    if (name.size() > VEO_SYMNAME_LEN_MAX) {
+      VEO_ERROR(this->worker.get(), "Too long name to preload: %s",
+                name.c_str());
+      reqids.push_back(VEO_REQUEST_ID_INVALID);
+      continue;
+    }
+    args.emplace_back(new CallArgs());
+    args.back()->setOnStack(VEO_INTENT_IN, 0,
+                            const_cast<char *>(name.c_str()),
+                            name.size() + 1);
+    reqids.push_back(this->worker->callAsync(this->funcs.load_library,
+                                             *args.back()));
+  }
+  for (size_t i = 0; i < names.size(); ++i) {
+    if (reqids[i] == VEO_REQUEST_ID_INVALID)
+      continue;
+    uint64_t handle;
+    int rv = this->worker->callWaitResult(reqids[i], &handle);
+    if (rv != VEO_COMMAND_OK || handle == 0) {
+      VEO_ERROR(this->worker.get(), "failed to preload %s (%d)",
+                names[i].c_str(), rv);
+      continue;
+    }
+    VEO_DEBUG(this->worker.get(), "preload %s: handle = %#lx",
+              names[i].c_str(), handle);
+    auto name = internal::canonical_library_name(names[i].c_str());
+    this->readSymbolTable(handle, name.c_str());
+    std::lock_guard<std::mutex> lock(this->lib_mtx);
+    this->lib_handle.emplace(name, handle);
+  }
+}
+
+/**
+ * @brief Read the symbol table of a library loaded on VH
+ *
+ * @param libhdl handle of library
+ * @param libname a library name passed to loadLibrary()
+ *
+ * The load base of the library is found by resolving one symbol on VE.
+ * Then, getSym() looks up symbols in the library on VH.
+ * When the file loaded on VE cannot be identified on VH, e.g., a library
+ * name without a slash searched by the dynamic linker on VE, or the file
+ * cannot be parsed, symbols are looked up on VE as before.
+ */
+void ProcHandle::readSymbolTable(const uint64_t libhdl, const char *libname)
+{
+  if (strchr(libname, '/') == nullptr) {
+    VEO_DEBUG(this->worker.get(), "%s is searched on VE.", libname);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(this->sym_mtx);
+    if (this->lib_symtab.find(libhdl) != this->lib_symtab.end())
+      return;// already loaded
+  }
+  std::unique_ptr<SymbolTable> symtab;
+  try {
+    symtab.reset(new SymbolTable(libname));
+  } catch (VEOException &e) {
+    VEO_DEBUG(this->worker.get(), "symbols in %s are resolved on VE: %s",
+              libname, e.what());
+    return;
+  }
+  uint64_t anchor_addr = this->findSymOnVE(libhdl, symtab->anchor());
+  if (anchor_addr == 0) {
+    VEO_DEBUG(this->worker.get(), "failed to find %s in %s on VE",
+              symtab->anchor(), libname);
+    return;
+  }
+  symtab->setAnchorAddress(anchor_addr);
+  std::lock_guard<std::mutex> lock(this->sym_mtx);
+  this->lib_symtab.emplace(libhdl, std::move(symtab));
+}
+
+/**
+ * @brief Find a symbol in VE program on VE
  *
  * @param libhdl handle of library
  * @param symname a symbol name to find
  * @return VEMVA of the symbol upon success; zero upon failure.
  */
-uint64_t ProcHandle::getSym(const uint64_t libhdl, const char *symname)
+uint64_t ProcHandle::findSymOnVE(const uint64_t libhdl, const char *symname)
 {
   size_t len = strlen(symname);
   if (len > VEO_SYMNAME_LEN_MAX) {
@@ -400,7 +600,31 @@ uint64_t ProcHandle::getSym(const uint64_t libhdl, const char *symname)
   CallArgs args;
   args.set(0, libhdl);
   args.setOnStack(VEO_INTENT_IN, 1, const_cast<char *>(symname), len + 1);
+  return doOnContext(this->worker.get(), this->funcs.find_sym, args);
+}
+
+/**
+ * @brief Find a symbol in VE program
+ *
+ * @param libhdl handle of library
+ * @param symname a symbol name to find
+ * @return VEMVA of the symbol upon success; zero upon failure.
+ *
+ * A symbol in a library whose symbol table is read on VH is found
+ * without a request to VE.
+ */
+uint64_t ProcHandle::getSym(const uint64_t libhdl, const char *symname)
+{
   sym_mtx.lock();
+  auto symtab = lib_symtab.find(libhdl);
+  if (symtab != lib_symtab.end()) {
+    auto addr = symtab->second->find(symname);
+    if (addr != 0) {
+      sym_mtx.unlock();
+      VEO_TRACE(this->worker.get(), "symbol addr = %#lx (VH)", addr);
+      return addr;
+    }
+  }
   auto itr = sym_name.find(symname);
   if( itr != sym_name.end() ) {
     sym_mtx.unlock();
@@ -408,8 +632,7 @@ uint64_t ProcHandle::getSym(const uint64_t libhdl, const char *symname)
     return itr->second;
   }
   sym_mtx.unlock();
-  uint64_t symaddr = doOnContext(this->worker.get(),
-                                 this->funcs.find_sym, args);
+  uint64_t symaddr = this->findSymOnVE(libhdl, symname);
   VEO_TRACE(this->worker.get(), "symbol addr = %#lx", symaddr);
   sym_mtx.lock();
   sym_name[symname] = symaddr;
@@ -425,9 +648,14 @@ uint64_t ProcHandle::getSym(const uint64_t libhdl, const char *symname)
  */
 uint64_t ProcHandle::allocBuff(const size_t size)
 {
-  std::lock_guard<std::mutex> lock(this->main_mutex);
-  CallArgs args{size};
-  return doOnContext(this->worker.get(), this->funcs.alloc_buff, args);
+  if (this->arena != nullptr)
+    return this->arena->alloc(size);
+  auto buff = this->allocRaw(size);
+  if (buff != 0) {
+    std::lock_guard<std::mutex> lock(this->buf_mtx);
+    this->buffers.insert(buff);
+  }
+  return buff;
 }
 
 /**
@@ -435,12 +663,98 @@ uint64_t ProcHandle::allocBuff(const size_t size)
  *
  * @param buff VEMVA of the buffer
  * @return nothing
+ *
+ * A buffer not in the arena, e.g., allocated by malloc() on VE, is freed
+ * by free() on VE.
  */
 void ProcHandle::freeBuff(const uint64_t buff)
 {
-  std::lock_guard<std::mutex> lock(this->main_mutex);
+  if (this->arena != nullptr && this->arena->free(buff))
+    return;
+  this->freeRaw(buff);
+  std::lock_guard<std::mutex> lock(this->buf_mtx);
+  this->buffers.erase(buff);
+}
+
+/**
+ * @brief Allocate memory on VE by malloc() on VE
+ */
+uint64_t ProcHandle::allocRaw(size_t size)
+{
+  CallArgs args{size};
+  return doOnContext(this->memWorker(), this->funcs.alloc_buff, args);
+}
+
+/**
+ * @brief Free memory on VE by free() on VE
+ */
+void ProcHandle::freeRaw(uint64_t buff)
+{
   CallArgs args{buff};
-  doOnContext(this->worker.get(), this->funcs.free_buff, args);
+  doOnContext(this->memWorker(), this->funcs.free_buff, args);
+}
+
+/**
+ * @brief get usage of the VE memory arena
+ *
+ * @param[out] stats statistics
+ */
+void ProcHandle::getMemStats(veo_mem_stats *stats)
+{
+  if (this->arena == nullptr) {
+    throw VEOException("VE memory arena is disabled", ENOTSUP);
+  }
+  this->arena->getStats(stats);
+}
+
+/**
+ * @brief Reset VE process for reuse
+ *
+ * Close VEO contexts left opened by users and the contexts of the
+ * dispatcher, free all buffers left allocated by allocBuff(), including
+ * all memory of the arena, unregister host memory and restore the
+ * default striping. Libraries loaded stay loaded. No call or transfer
+ * may be in flight.
+ */
+void ProcHandle::reset()
+{
+  std::unordered_set<ThreadContext *> ctxs;
+  {
+    std::lock_guard<std::mutex> lock(this->ctx_mtx);
+    ctxs.swap(this->user_contexts);
+  }
+  VEO_TRACE(this->worker.get(), "%s(): %lu contexts to close", __func__,
+            ctxs.size());
+  for (auto ctx: ctxs) {
+    if (this->closeContext(ctx) != 0)
+      throw VEOException("failed to close a context", EBUSY);
+  }
+  this->dispatcher->closeAll();
+  this->host_mem.clear();
+  this->stripe_chunk = internal::default_stripe_chunk;
+  this->stripe_lanes = 0;
+  this->memWorker();// open contexts before main_mutex is acquired.
+  std::lock_guard<std::mutex> lock(this->main_mutex);
+  if (this->arena != nullptr)
+    this->arena->reset();
+  std::lock_guard<std::mutex> buf_lock(this->buf_mtx);
+  VEO_TRACE(this->worker.get(), "%s(): %lu buffers to free", __func__,
+            this->buffers.size());
+  for (auto buff: this->buffers) {
+    this->freeRaw(buff);
+  }
+  this->buffers.clear();
+}
+
+/**
+ * @brief destructor
+ *
+ * exitProc() needs to be called before. The worker is left to its pseudo
+ * thread, which is not joined.
+ */
+ProcHandle::~ProcHandle()
+{
+  this->worker.release();// still referred to by the pseudo thread
 }
 
 /**
@@ -449,33 +763,312 @@ void ProcHandle::freeBuff(const uint64_t buff)
  */
 void ProcHandle::exitProc()
 {
-  std::lock_guard<std::mutex> lock(this->main_mutex);
   VEO_TRACE(this->main_thread.get(), "%s()", __func__);
-  process_thread_cleanup(this->osHandle(), -1);
+  // stop the monitor and close the contexts of the dispatcher before
+  // main_mutex is held; the monitor can be opening contexts with it.
+  this->closing = true;
+  this->dispatcher->closeAll();
+  this->closeOwnContexts();
+  std::lock_guard<std::mutex> lock(this->main_mutex);
+  // process_thread_cleanup() refers to g_handle of the calling thread.
+  auto saved_handle = g_handle;
+  g_handle = this->osHandle();
+  {
+    ProcStateGuard guard(&this->state);
+    process_thread_cleanup(this->osHandle(), -1);
+  }
+  g_handle = saved_handle;
   this->main_thread.get()->state = VEO_STATE_EXIT;
   veos_handle_free(this->osHandle());
+  {
+    std::lock_guard<std::mutex> home_lock(this->home_mtx);
+    this->exiting = true;
+  }
+  this->home_cond.notify_all();
+  if (this->home_thread.joinable())
+    this->home_thread.join();
   return;
 }
 
+/**
+ * @brief close contexts owned by this process
+ *
+ * Contexts kept for reuse and contexts serving memory operations are
+ * closed, so that their pseudo threads exit with the process.
+ */
+void ProcHandle::closeOwnContexts()
+{
+  std::deque<ThreadContext *> idle;
+  {
+    std::lock_guard<std::mutex> lock(this->ctx_mtx);
+    idle.swap(this->idle_contexts);
+  }
+  for (auto ctx: idle) {
+    if (ctx->close() == 0)
+      delete ctx;
+  }
+  if (!this->mem_workers.empty())
+    this->mem_workers.resize(1);// the worker only
+  for (auto &ctx: this->mem_contexts) {
+    if (ctx->close() != 0) {
+      VEO_ERROR(ctx.get(), "failed to close context %p", ctx.get());
+      ctx.release();// still referred to by the pseudo thread
+    }
+  }
+  this->mem_contexts.clear();
+}
+
+/**
+ * @brief keep the calling thread, which created this process, until exit
+ *
+ * The main thread of the VE process and the shared memory for its system
+ * calls are bound to the host thread creating the process; the thread
+ * has to live as long as the process.
+ */
+void ProcHandle::parkHomeThread()
+{
+  std::unique_lock<std::mutex> lock(this->home_mtx);
+  this->home_cond.wait(lock, [this] { return this->exiting; });
+}
+
+/**
+ * @brief take the ownership of the thread which created this process
+ *
+ * @param t thread parked by parkHomeThread(); joined on exitProc().
+ */
+void ProcHandle::adoptHomeThread(std::thread &&t)
+{
+  this->home_thread = std::move(t);
+}
+
 /**
  * @brief open a new context (VE thread)
  *
  * @return a new thread context created
+ *
+ * A context closed before is reused if available.
  */
 ThreadContext *ProcHandle::openContext()
 {
-  CallArgs args;
-  std::lock_guard<std::mutex> lock(this->main_mutex);
+  ThreadContext *ctx;
+  this->openContexts(1, &ctx);
+  return ctx;
+}
+
+/**
+ * @brief open contexts (VE threads)
+ *
+ * @param n the number of contexts to open
+ * @param[out] ctxs array to store n thread contexts
+ * @param user true if the contexts are for users, closed on reset();
+ *             false for contexts owned by libveo.
+ *
+ * Contexts closed before are reused first. Requests to create the rest
+ * are queued to the worker at once, so that the worker creates VE
+ * threads one after another without waiting for the caller.
+ */
+void ProcHandle::openContexts(int n, ThreadContext **ctxs, bool user)
+{
+  if (n <= 0) {
+    throw VEOException("invalid number of contexts", EINVAL);
+  }
+  if (this->closing) {
+    throw VEOException("the process is exiting", ESRCH);
+  }
+  int nreused = 0;
+  {
+    std::lock_guard<std::mutex> lock(this->ctx_mtx);
+    while (nreused < n && !this->idle_contexts.empty()) {
+      ctxs[nreused++] = this->idle_contexts.back();
+      this->idle_contexts.pop_back();
+    }
+    if (nreused == n && user)
+      this->user_contexts.insert(ctxs, ctxs + n);
+  }
+  if (nreused == n)
+    return;
+  VEO_DEBUG(nullptr, "%d contexts reused; opening %d contexts",
+            nreused, n - nreused);
 
+  std::lock_guard<std::mutex> lock(this->main_mutex);
+  if (this->closing) {
+    for (int i = 0; i < nreused; ++i) {
+      if (ctxs[i]->close() == 0)
+        delete ctxs[i];
+    }
+    throw VEOException("the process is exiting", ESRCH);
+  }
   auto ctx = this->worker.get();
-  auto reqid = ctx->_callOpenContext(this, this->funcs.create_thread, args);
-  uintptr_t ret;
-  int rv = ctx->callWaitResult(reqid, &ret);
-  if (rv != VEO_COMMAND_OK) {
-    VEO_ERROR(ctx, "openContext failed (%d)", rv);
+  std::vector<std::unique_ptr<CallArgs> > args(n - nreused);
+  std::vector<uint64_t> reqids(n - nreused);
+  for (int i = 0; i < n - nreused; ++i) {
+    args[i].reset(new CallArgs());
+    reqids[i] = ctx->_callOpenContext(this, this->funcs.create_thread,
+                                      *args[i]);
+  }
+  int nfailed = 0;
+  int nopened = nreused;
+  for (auto reqid: reqids) {
+    uintptr_t ret;
+    int rv = ctx->callWaitResult(reqid, &ret);
+    if (rv != VEO_COMMAND_OK) {
+      VEO_ERROR(ctx, "openContext failed (%d)", rv);
+      ++nfailed;
+      continue;
+    }
+    ctxs[nopened++] = reinterpret_cast<ThreadContext *>(ret);
+  }
+  if (nfailed > 0) {
+    std::lock_guard<std::mutex> lock(this->ctx_mtx);
+    for (int i = 0; i < nopened; ++i)
+      this->idle_contexts.push_back(ctxs[i]);
     throw VEOException("request failed", ENOSYS);
   }
-  return reinterpret_cast<ThreadContext *>(ret);
+  if (user) {
+    std::lock_guard<std::mutex> lock(this->ctx_mtx);
+    this->user_contexts.insert(ctxs, ctxs + n);
+  }
+}
+
+/**
+ * @brief close a context (VE thread)
+ *
+ * @param ctx thread context to close
+ * @return zero upon success; negative upon failure.
+ *
+ * An idle context is kept for reuse instead of terminating its VE thread
+ * and pseudo thread; a context with results not collected or not blocked
+ * normally is terminated. The transfer lane and the VE buffer for
+ * arguments of a context kept are released.
+ */
+int ProcHandle::closeContext(ThreadContext *ctx)
+{
+  {
+    std::lock_guard<std::mutex> lock(this->ctx_mtx);
+    this->user_contexts.erase(ctx);
+  }
+  if (ctx->isIdle()) {
+    VEO_DEBUG(ctx, "context %p is kept for reuse", ctx);
+    ctx->closeTransferLane();
+    ctx->releaseHeapBuffer();
+    std::lock_guard<std::mutex> lock(this->ctx_mtx);
+    this->idle_contexts.push_back(ctx);
+    return 0;
+  }
+  int rv = ctx->close();
+  if (rv == 0) {
+    delete ctx;
+  }
+  return rv;
+}
+
+/**
+ * @brief open contexts serving memory operations
+ *
+ * The number of contexts is specified by VEO_MEM_WORKERS, including the
+ * worker. Memory operations are served by the worker alone if no more
+ * contexts are available.
+ */
+void ProcHandle::openMemWorkers()
+{
+  int n = internal::default_mem_workers;
+  const char *env = getenv("VEO_MEM_WORKERS");
+  if (env != nullptr)
+    n = atoi(env);
+  this->mem_workers.push_back(this->worker.get());
+  if (n <= 1)
+    return;
+  std::vector<ThreadContext *> ctxs(n - 1);
+  try {
+    this->openContexts(n - 1, ctxs.data(), false);
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "failed to open contexts for memory operations: %s",
+              e.what());
+    return;
+  }
+  for (auto ctx: ctxs) {
+    this->mem_contexts.emplace_back(ctx);
+    this->mem_workers.push_back(ctx);
+  }
+  VEO_DEBUG(nullptr, "%d contexts serve memory operations", n);
+}
+
+/**
+ * @brief get the context serving memory operations of the calling thread
+ *
+ * @param lane offset from the context assigned to the calling thread
+ *
+ * Each host thread is assigned to one of the contexts round robin, so
+ * that operations from different threads run concurrently.
+ */
+ThreadContext *ProcHandle::memWorker(unsigned int lane)
+{
+  static std::atomic<unsigned int> next_index(0);
+  static thread_local unsigned int index = next_index++;
+  std::call_once(this->mem_once, &ProcHandle::openMemWorkers, this);
+  return this->mem_workers[(index + lane) % this->mem_workers.size()];
+}
+
+/**
+ * @brief configure striped transfers
+ *
+ * @param chunk size of a chunk; a transfer larger than this is split.
+ * @param lanes the number of contexts to transfer chunks in parallel;
+ *        zero to use all contexts serving memory operations.
+ */
+void ProcHandle::setStriping(size_t chunk, int lanes)
+{
+  if (chunk == 0 || lanes < 0) {
+    throw VEOException("invalid striping parameters", EINVAL);
+  }
+  this->stripe_chunk = chunk;
+  this->stripe_lanes = lanes;
+}
+
+/**
+ * @brief transfer data between VH and VE
+ *
+ * @param host VHVA
+ * @param ve VEMVA
+ * @param size size to transfer in byte
+ * @param read true to read from VE; false to write to VE.
+ * @return zero upon success; negative upon failure
+ *
+ * A transfer larger than the chunk size is split into chunks issued on
+ * the contexts serving memory operations at once, each with its own
+ * VEOS handle, and completes when all chunks complete. The result of the
+ * first chunk failed is returned.
+ */
+int ProcHandle::transfer(void *host, uint64_t ve, size_t size, bool read)
+{
+  size_t chunk = this->stripe_chunk;
+  int lanes = this->stripe_lanes;
+  this->memWorker();// open contexts before the number is referred to.
+  if (lanes == 0 || lanes > this->mem_workers.size())
+    lanes = this->mem_workers.size();
+  if (lanes == 1 || size <= chunk)
+    chunk = std::max(size, 1UL);
+  std::vector<std::pair<ThreadContext *, uint64_t> > reqs;
+  reqs.reserve(size / chunk + 1);
+  for (size_t off = 0; off < size || reqs.empty(); off += chunk) {
+    auto len = std::min(chunk, size - off);
+    auto ctx = this->memWorker(reqs.size() % lanes);
+    auto p = static_cast<char *>(host) + off;
+    auto id = read ? ctx->asyncReadMem(p, ve + off, len)
+                   : ctx->asyncWriteMem(ve + off, p, len);
+    reqs.emplace_back(ctx, id);
+  }
+  int rv = 0;
+  for (auto &r: reqs) {
+    uint64_t ret;
+    int status = r.first->callWaitResult(r.second, &ret);
+    if (rv != 0)
+      continue;
+    rv = static_cast<int>(ret);
+    if (status != VEO_COMMAND_OK && rv == 0)
+      rv = -1;
+  }
+  return rv;
 }
 
 /**
@@ -487,13 +1080,8 @@ ThreadContext *ProcHandle::openContext()
  */
 int ProcHandle::readMem(void *dst, uint64_t src, size_t size)
 {
-  std::lock_guard<std::mutex> lock(this->main_mutex);
   VEO_TRACE(nullptr, "readMem(%p, %#lx, %ld)", dst, src, size);
-  auto id = this->worker->asyncReadMem(dst, src, size);
-  uint64_t ret;
-  int rv = this->worker->callWaitResult(id, &ret);
-  VEO_ASSERT(rv == VEO_COMMAND_OK);
-  return static_cast<int>(ret);
+  return this->transfer(dst, src, size, true);
 }
 
 /**
@@ -505,12 +1093,7 @@ int ProcHandle::readMem(void *dst, uint64_t src, size_t size)
  */
 int ProcHandle::writeMem(uint64_t dst, const void *src, size_t size)
 {
-  std::lock_guard<std::mutex> lock(this->main_mutex);
   VEO_TRACE(nullptr, "writeMem(%#lx, %p, %ld)", dst, src, size);
-  auto id = this->worker->asyncWriteMem(dst, src, size);
-  uint64_t ret;
-  int rv = this->worker->callWaitResult(id, &ret);
-  VEO_ASSERT(rv == VEO_COMMAND_OK);
-  return static_cast<int>(ret);
+  return this->transfer(const_cast<void *>(src), dst, size, false);
 }
 } // namespace veo
@@ -4,14 +4,26 @@
  */
 #ifndef _VEO_PROC_HANDLE_HPP_
 #define _VEO_PROC_HANDLE_HPP_
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
 #include <mutex>
 #include <iostream>
+#include <thread>
+#include <vector>
 
 #include <ve_offload.h>
 #include <veorun.h>
 #include "ThreadContext.hpp"
+#include "Dispatcher.hpp"
+#include "HostMemRegistry.hpp"
+#include "MemArena.hpp"
+#include "ProcState.hpp"
+#include "StartupProfile.hpp"
+#include "SymbolTable.hpp"
 #include "VEOException.hpp"
 
 namespace veo {
@@ -21,12 +33,41 @@ namespace veo {
  */
 class ProcHandle {
 private:
+  ProcState state;//!< the state of VE process in libvepseudo
   std::unordered_map<std::string, uint64_t> sym_name;
+  //! handles of libraries loaded, keyed by canonicalized path
+  std::unordered_map<std::string, uint64_t> lib_handle;
+  std::mutex lib_mtx;
+  //! symbol tables of libraries loaded, read on VH
+  std::unordered_map<uint64_t, std::unique_ptr<SymbolTable> > lib_symtab;
   std::mutex sym_mtx;
   std::mutex main_mutex;//!< acquire while using main_thread
   std::unique_ptr<ThreadContext> main_thread;
   std::unique_ptr<ThreadContext> worker;
+  //! contexts serving memory operations, sharded by host thread
+  std::vector<ThreadContext *> mem_workers;
+  std::vector<std::unique_ptr<ThreadContext> > mem_contexts;
+  std::once_flag mem_once;
+  std::atomic<size_t> stripe_chunk;//!< chunk size of a striped transfer
+  std::atomic<int> stripe_lanes;//!< contexts for a striped transfer
   struct veo__helper_functions funcs;
+  //! buffers allocated by allocBuff without the arena
+  std::unordered_set<uint64_t> buffers;
+  std::mutex buf_mtx;
+  std::unique_ptr<MemArena> arena;//!< VE memory managed on VH
+  HostMemRegistry host_mem;//!< host memory registered for transfers
+  StartupProfile startup;//!< timings of the creation of the process
+  std::deque<ThreadContext *> idle_contexts;//!< contexts closed for reuse
+  //! contexts opened by users and not closed yet
+  std::unordered_set<ThreadContext *> user_contexts;
+  std::mutex ctx_mtx;
+  std::unique_ptr<Dispatcher> dispatcher;
+  //! host thread the process was created on, kept until exit
+  std::thread home_thread;
+  std::mutex home_mtx;
+  std::condition_variable home_cond;
+  bool exiting;
+  std::atomic<bool> closing;//!< exitProc() has started
 
   /**
    * @brief run VE main thread until BLOCK call.
@@ -39,6 +80,15 @@ private:
     }
   }
   veos_handle *osHandle() { return this->main_thread->os_handle; }
+  void openMemWorkers();
+  void closeOwnContexts();
+  ThreadContext *memWorker(unsigned int lane = 0);
+  int transfer(void *, uint64_t, size_t, bool);
+  uint64_t allocRaw(size_t);
+  void freeRaw(uint64_t);
+  uint64_t findSymOnVE(const uint64_t, const char *);
+  void readSymbolTable(const uint64_t, const char *);
+  void preloadLibraries(const char *);
 public:
   ProcHandle(const char *, const char *, const char *);
   ~ProcHandle();
@@ -48,13 +98,28 @@ public:
 
   uint64_t allocBuff(const size_t);
   void freeBuff(const uint64_t);
+  void getMemStats(veo_mem_stats *);
+  bool hasArena() const { return this->arena != nullptr; }
 
   int readMem(void *, uint64_t, size_t);
   int writeMem(uint64_t, const void *, size_t);
+  void setStriping(size_t, int);
+  int transferIov(const struct iovec *, int, const struct veo_iovec *, int,
+                  bool);
+  int transfer2D(void *, size_t, uint64_t, size_t, size_t, size_t, bool);
 
   void exitProc(void);
+  void parkHomeThread();
+  void adoptHomeThread(std::thread &&);
+  void reset(void);
 
   ThreadContext *openContext();
+  void openContexts(int, ThreadContext **, bool user = true);
+  int closeContext(ThreadContext *);
+  Dispatcher *getDispatcher() { return this->dispatcher.get(); }
+  ProcState *procState() { return &this->state; }
+  HostMemRegistry &hostMem() { return this->host_mem; }
+  const StartupProfile &startupProfile() const { return this->startup; }
   
   veo_proc_handle *toCHandle() {
     return reinterpret_cast<veo_proc_handle *>(this);
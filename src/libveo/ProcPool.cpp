@@ -0,0 +1,120 @@
+/**
+ * @file ProcPool.cpp
+ * @brief implementation of ProcPool
+ */
+#include "ProcPool.hpp"
+#include "ProcHandle.hpp"
+#include "VEOException.hpp"
+#include "log.hpp"
+
+namespace veo {
+/**
+ * @brief constructor
+ *
+ * @param ossock path to VE OS socket
+ * @param vedev path to VE device file
+ * @param binname VE executable
+ * @param n the number of VE processes created in advance
+ */
+ProcPool::ProcPool(const char *ossock, const char *vedev, const char *binname,
+                   int n): ossock(ossock), vedev(vedev), binname(binname)
+{
+  if (n < 0) {
+    throw VEOException("invalid number of processes", EINVAL);
+  }
+  try {
+    for (int i = 0; i < n; ++i) {
+      auto proc = new ProcHandle(ossock, vedev, binname);
+      this->members.insert(proc);
+      this->idle.push_back(proc);
+    }
+  } catch (VEOException &e) {
+    this->destroy();
+    throw;
+  }
+}
+
+/**
+ * @brief acquire a VE process
+ *
+ * @return a VE process ready to use
+ *
+ * When all processes are in use, a new process is created and added
+ * to the pool.
+ */
+ProcHandle *ProcPool::acquire()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mtx);
+    if (!this->idle.empty()) {
+      auto proc = this->idle.front();
+      this->idle.pop_front();
+      this->in_use.insert(proc);
+      return proc;
+    }
+  }
+  VEO_DEBUG(nullptr, "no idle process in pool %p; creating.", this);
+  auto proc = new ProcHandle(this->ossock.c_str(), this->vedev.c_str(),
+                             this->binname.c_str());
+  std::lock_guard<std::mutex> lock(this->mtx);
+  this->members.insert(proc);
+  this->in_use.insert(proc);
+  return proc;
+}
+
+/**
+ * @brief release a VE process to the pool
+ *
+ * @param proc a VE process acquired from this pool
+ *
+ * The process is reset by ProcHandle::reset(): contexts, buffers and
+ * host registrations left by the user are released. A process failed to
+ * reset is terminated, removed from the pool and deleted. A process not acquired,
+ * e.g., released twice, is rejected.
+ */
+void ProcPool::release(ProcHandle *proc)
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mtx);
+    if (this->members.find(proc) == this->members.end()) {
+      throw VEOException("the process is not in the pool", EINVAL);
+    }
+    if (this->in_use.erase(proc) == 0) {
+      throw VEOException("the process is not acquired", EINVAL);
+    }
+  }
+  try {
+    proc->reset();
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "failed to reset process %p: %s", proc, e.what());
+    std::lock_guard<std::mutex> lock(this->mtx);
+    this->members.erase(proc);
+    proc->exitProc();
+    delete proc;
+    throw;
+  }
+  std::lock_guard<std::mutex> lock(this->mtx);
+  this->idle.push_back(proc);
+}
+
+/**
+ * @brief terminate processes in the pool
+ *
+ * @return the number of processes still acquired, not terminated.
+ */
+int ProcPool::destroy()
+{
+  std::lock_guard<std::mutex> lock(this->mtx);
+  for (auto proc: this->idle) {
+    try {
+      proc->exitProc();
+    } catch (VEOException &e) {
+      VEO_ERROR(nullptr, "failed to terminate process %p: %s",
+                proc, e.what());
+    }
+    this->members.erase(proc);
+  }
+  this->idle.clear();
+  return this->members.size();
+}
+} // namespace veo
@@ -0,0 +1,46 @@
+/**
+ * @file ProcPool.hpp
+ * @brief pool of VE processes created in advance
+ */
+#ifndef _VEO_PROC_POOL_HPP_
+#define _VEO_PROC_POOL_HPP_
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+#include <ve_offload.h>
+
+namespace veo {
+class ProcHandle;
+
+/**
+ * @brief pool of VE processes
+ *
+ * VE processes are created on creation of the pool and handed out by
+ * acquire(). A process released is reset and handed out again.
+ */
+class ProcPool {
+private:
+  std::string ossock;
+  std::string vedev;
+  std::string binname;
+  std::mutex mtx;
+  std::deque<ProcHandle *> idle;//!< processes ready to be acquired
+  std::unordered_set<ProcHandle *> members;//!< all processes in the pool
+  std::unordered_set<ProcHandle *> in_use;//!< processes acquired
+public:
+  ProcPool(const char *, const char *, const char *, int);
+  ~ProcPool() = default;
+  ProcPool(const ProcPool &) = delete;
+
+  ProcHandle *acquire();
+  void release(ProcHandle *);
+  int destroy();
+
+  veo_proc_pool *toCHandle() {
+    return reinterpret_cast<veo_proc_pool *>(this);
+  }
+};
+} // namespace veo
+#endif
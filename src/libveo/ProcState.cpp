@@ -0,0 +1,48 @@
+/**
+ * @file ProcState.cpp
+ * @brief implementation of ProcState
+ */
+#include <cstdlib>
+#include "ProcState.hpp"
+#include "VEOException.hpp"
+#include "log.hpp"
+
+namespace veo {
+namespace internal {
+std::recursive_mutex state_mtx;//!< acquire while the globals are used
+ProcState *current_state;//!< the VE process in the global variables
+} // namespace internal
+
+ProcState::ProcState()
+{
+  this->state = veo_proc_state_alloc();
+  if (this->state == nullptr) {
+    throw VEOException("failed to allocate the state of VE process");
+  }
+}
+
+ProcState::~ProcState()
+{
+  std::lock_guard<std::recursive_mutex> lock(internal::state_mtx);
+  if (internal::current_state == this)
+    internal::current_state = nullptr;
+  free(this->state);
+}
+
+/**
+ * @brief constructor
+ *
+ * @param s the state of VE process to be switched to
+ */
+ProcStateGuard::ProcStateGuard(ProcState *s): lock(internal::state_mtx)
+{
+  auto current = internal::current_state;
+  if (current == s)
+    return;
+  VEO_TRACE(nullptr, "switch VE process state %p -> %p", current, s);
+  if (current != nullptr)
+    veo_proc_state_save(current->state);
+  veo_proc_state_load(s->state);
+  internal::current_state = s;
+}
+} // namespace veo
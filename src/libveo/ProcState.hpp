@@ -0,0 +1,61 @@
+/**
+ * @file ProcState.hpp
+ * @brief state of VE process held in global variables of libvepseudo
+ */
+#ifndef _VEO_PROC_STATE_HPP_
+#define _VEO_PROC_STATE_HPP_
+#include <mutex>
+
+extern "C" {
+/* defined in vars.c */
+struct veo_proc_state;
+struct veo_proc_state *veo_proc_state_alloc(void);
+void veo_proc_state_save(struct veo_proc_state *);
+void veo_proc_state_load(struct veo_proc_state *);
+}
+
+namespace veo {
+/**
+ * @brief state of a VE process
+ *
+ * libvepseudo keeps the state of a VE process, e.g., VEMVA space and
+ * pseudo thread information, in global variables. ProcState holds a copy
+ * of them for each VE process; ProcStateGuard switches the global
+ * variables to the VE process while functions in libvepseudo referring to
+ * them are called. Locks in the global variables are not part of the
+ * copy; see vars.c.
+ *
+ * Only system call handlers referring to VEMVA space or thread
+ * information, e.g., mmap() and clone(), run with the switch; the others,
+ * including all which can block, run without it. A switch copies thread
+ * information only up to the last slot in use. Threads created by VE
+ * code itself, e.g., by OpenMP, are handled by libvepseudo without the
+ * switch; a host process driving more than one VE process must not run
+ * such VE code.
+ */
+class ProcState {
+  friend class ProcStateGuard;
+private:
+  struct veo_proc_state *state;
+public:
+  ProcState();
+  ~ProcState();
+  ProcState(const ProcState &) = delete;
+};
+
+/**
+ * @brief scoped switch of the global variables to a VE process
+ *
+ * Only one VE process can be handled at a time; a guard for another VE
+ * process waits until the guard currently held is released. The guard
+ * can be nested in the same thread.
+ */
+class ProcStateGuard {
+private:
+  std::unique_lock<std::recursive_mutex> lock;
+public:
+  explicit ProcStateGuard(ProcState *);
+  ProcStateGuard(const ProcStateGuard &) = delete;
+};
+} // namespace veo
+#endif
@@ -0,0 +1,100 @@
+/**
+ * @file StartupProfile.cpp
+ * @brief implementation of StartupProfile
+ */
+#include <cstdio>
+#include "StartupProfile.hpp"
+#include "VEOException.hpp"
+
+namespace veo {
+namespace internal {
+//! names of phases in JSON
+const char *startup_phase_name[VEO_STARTUP_NUM_PHASES] = {
+  "os_handle",
+  "shm",
+  "new_proc",
+  "load_elf",
+  "init_stack",
+  "start_proc",
+  "libc_init",
+  "helper_fetch",
+  "worker_clone",
+  "preload",
+};
+} // namespace internal
+
+StartupProfile::StartupProfile(): elapsed()
+{
+  this->start();
+}
+
+/**
+ * @brief start measurement
+ */
+void StartupProfile::start()
+{
+  this->last = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief charge the time since the last mark to a phase
+ *
+ * @param phase phase of VE process creation
+ */
+void StartupProfile::mark(int phase)
+{
+  auto now = std::chrono::steady_clock::now();
+  this->elapsed[phase] +=
+    std::chrono::duration<double>(now - this->last).count();
+  this->last = now;
+}
+
+/**
+ * @brief get the elapsed time of a phase
+ *
+ * @param phase phase of VE process creation
+ * @return elapsed time in seconds
+ */
+double StartupProfile::get(int phase) const
+{
+  if (phase < 0 || phase >= VEO_STARTUP_NUM_PHASES) {
+    throw VEOException("invalid startup phase", EINVAL);
+  }
+  return this->elapsed[phase];
+}
+
+/**
+ * @brief get the total elapsed time of VE process creation
+ */
+double StartupProfile::total() const
+{
+  double sum = 0;
+  for (auto t: this->elapsed)
+    sum += t;
+  return sum;
+}
+
+/**
+ * @brief format the timings as a JSON object
+ *
+ * @param buf buffer to store the JSON string
+ * @param len size of the buffer
+ * @return the length of the JSON string, excluding the terminating null
+ *         byte, as snprintf() returns.
+ */
+int StartupProfile::toJSON(char *buf, size_t len) const
+{
+  size_t pos = 0;
+  auto append = [&](const char *name, double val, const char *sep) {
+    auto n = snprintf(pos < len ? buf + pos : nullptr,
+                      pos < len ? len - pos : 0,
+                      "\"%s\": %.9f%s", name, val, sep);
+    pos += n;
+  };
+  pos += snprintf(buf, len, "{");
+  for (int i = 0; i < VEO_STARTUP_NUM_PHASES; ++i)
+    append(internal::startup_phase_name[i], this->elapsed[i], ", ");
+  append("total", this->total(), "}");
+  return pos;
+}
+} // namespace veo
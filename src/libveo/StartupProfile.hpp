@@ -0,0 +1,33 @@
+/**
+ * @file StartupProfile.hpp
+ * @brief timings of VE process creation
+ */
+#ifndef _VEO_STARTUP_PROFILE_HPP_
+#define _VEO_STARTUP_PROFILE_HPP_
+#include <chrono>
+#include <cstddef>
+
+#include <ve_offload.h>
+
+namespace veo {
+/**
+ * @brief elapsed time of each phase of VE process creation
+ *
+ * mark() charges the time since the previous mark to a phase.
+ */
+class StartupProfile {
+private:
+  std::chrono::steady_clock::time_point last;
+  double elapsed[VEO_STARTUP_NUM_PHASES];//!< in seconds
+public:
+  StartupProfile();
+  StartupProfile(const StartupProfile &) = delete;
+
+  void start();
+  void mark(int);
+  double get(int) const;
+  double total() const;
+  int toJSON(char *, size_t) const;
+};
+} // namespace veo
+#endif
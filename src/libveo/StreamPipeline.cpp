@@ -0,0 +1,209 @@
+/**
+ * @file StreamPipeline.cpp
+ * @brief implementation of StreamPipeline
+ */
+#include <algorithm>
+#include <thread>
+#include "StreamPipeline.hpp"
+#include "ProcHandle.hpp"
+#include "ThreadContext.hpp"
+#include "VEOException.hpp"
+#include "log.hpp"
+
+namespace veo {
+namespace internal {
+void SlotQueue::push(int slot)
+{
+  std::lock_guard<std::mutex> lock(this->mtx);
+  this->queue.push_back(slot);
+  this->cond.notify_one();
+}
+
+int SlotQueue::pop()
+{
+  std::unique_lock<std::mutex> lock(this->mtx);
+  while (this->queue.empty())
+    this->cond.wait(lock);
+  auto rv = this->queue.front();
+  this->queue.pop_front();
+  return rv;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point t)
+{
+  return std::chrono::duration<double>(
+           std::chrono::steady_clock::now() - t).count();
+}
+} // namespace internal
+
+/**
+ * @brief constructor
+ *
+ * @param c context to call the function on
+ * @param addr VEMVA of the function
+ * @param in_size size of an input buffer
+ * @param out_size size of an output buffer
+ * @param depth the number of buffer pairs in flight
+ */
+StreamPipeline::StreamPipeline(ThreadContext *c, uint64_t addr,
+                               size_t in_size, size_t out_size, int depth):
+  ctx(c), proc(c->procHandle()), addr(addr), in_size(in_size),
+  out_size(out_size), slots(depth > 0 ? depth : 0), failed(false), stats()
+{
+  if (depth <= 0 || in_size == 0) {
+    throw VEOException("invalid stream parameters", EINVAL);
+  }
+  for (auto &s: this->slots) {
+    s.vein = s.veout = 0;
+  }
+  try {
+    for (auto &s: this->slots) {
+      s.hostbuf.resize(std::max(in_size, out_size));
+      s.vein = this->proc->allocBuff(in_size);
+      if (out_size > 0)
+        s.veout = this->proc->allocBuff(out_size);
+      if (s.vein == 0 || (out_size > 0 && s.veout == 0))
+        throw VEOException("failed to allocate VE buffer", ENOMEM);
+    }
+  } catch (VEOException &e) {
+    for (auto &s: this->slots) {
+      if (s.vein != 0)
+        this->proc->freeBuff(s.vein);
+      if (s.veout != 0)
+        this->proc->freeBuff(s.veout);
+    }
+    throw;
+  }
+}
+
+StreamPipeline::~StreamPipeline()
+{
+  for (auto &s: this->slots) {
+    this->proc->freeBuff(s.vein);
+    if (s.veout != 0)
+      this->proc->freeBuff(s.veout);
+  }
+}
+
+/**
+ * @brief upload stage: fill input buffers from the source
+ */
+void StreamPipeline::upload(veo_stream_source source, void *data)
+{
+  for (;;) {
+    auto i = this->free_slots.pop();
+    if (i < 0 || this->failed)
+      break;
+    auto &s = this->slots[i];
+    auto len = source(s.hostbuf.data(), this->in_size, data);
+    if (len == 0)
+      break;// end of stream
+    auto start = std::chrono::steady_clock::now();
+    if (len > this->in_size ||
+        this->proc->writeMem(s.vein, s.hostbuf.data(), len) != 0) {
+      VEO_ERROR(this->ctx, "failed to upload %lu bytes", len);
+      this->failed = true;
+      break;
+    }
+    this->stats.write_time += internal::seconds_since(start);
+    this->stats.bytes_in += len;
+    s.in_len = len;
+    this->ready_slots.push(i);
+  }
+  this->ready_slots.push(-1);
+}
+
+/**
+ * @brief compute stage: call the VE function on each input buffer
+ *
+ * The function is called as func(in, in_len, out, out_size) and returns
+ * the size of the output.
+ */
+void StreamPipeline::compute()
+{
+  for (;;) {
+    auto i = this->ready_slots.pop();
+    if (i < 0)
+      break;
+    auto &s = this->slots[i];
+    auto start = std::chrono::steady_clock::now();
+    s.args.clear();
+    s.args.set(0, s.vein);
+    s.args.set(1, static_cast<uint64_t>(s.in_len));
+    s.args.set(2, s.veout);
+    s.args.set(3, static_cast<uint64_t>(this->out_size));
+    uint64_t ret;
+    auto reqid = this->ctx->callAsync(this->addr, s.args);
+    int rv = this->ctx->callWaitResult(reqid, &ret);
+    this->stats.call_time += internal::seconds_since(start);
+    if (rv != VEO_COMMAND_OK || ret > this->out_size) {
+      VEO_ERROR(this->ctx, "VE function failed (%d, %lu)", rv, ret);
+      this->failed = true;
+      this->free_slots.push(-1);// stop the upload stage
+      break;
+    }
+    s.out_len = ret;
+    ++this->stats.chunks;
+    this->done_slots.push(i);
+  }
+  this->done_slots.push(-1);
+}
+
+/**
+ * @brief download stage: pass output buffers to the sink
+ */
+void StreamPipeline::download(veo_stream_sink sink, void *data)
+{
+  for (;;) {
+    auto i = this->done_slots.pop();
+    if (i < 0)
+      break;
+    auto &s = this->slots[i];
+    if (s.out_len > 0 && !this->failed) {
+      auto start = std::chrono::steady_clock::now();
+      if (this->proc->readMem(s.hostbuf.data(), s.veout, s.out_len) != 0) {
+        VEO_ERROR(this->ctx, "failed to download %lu bytes", s.out_len);
+        this->failed = true;
+      }
+      this->stats.read_time += internal::seconds_since(start);
+      this->stats.bytes_out += s.out_len;
+    }
+    if (!this->failed && sink != nullptr &&
+        sink(s.hostbuf.data(), s.out_len, data) != 0) {
+      VEO_ERROR(this->ctx, "sink failed on %lu bytes", s.out_len);
+      this->failed = true;
+    }
+    this->free_slots.push(this->failed ? -1 : i);
+  }
+}
+
+/**
+ * @brief run the pipeline until the source ends
+ *
+ * @param source callback to fill an input buffer
+ * @param sink callback to consume an output buffer; can be nullptr.
+ * @param data pointer passed to the callbacks
+ * @return zero upon success; -1 upon failure.
+ */
+int StreamPipeline::run(veo_stream_source source, veo_stream_sink sink,
+                        void *data)
+{
+  this->stats = veo_stream_stats();
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < this->slots.size(); ++i)
+    this->free_slots.push(i);
+  std::thread uploader(&StreamPipeline::upload, this, source, data);
+  std::thread downloader(&StreamPipeline::download, this, sink, data);
+  this->compute();
+  uploader.join();
+  downloader.join();
+
+  auto &st = this->stats;
+  st.elapsed = internal::seconds_since(start);
+  if (st.elapsed > 0) {
+    st.overlap = (st.write_time + st.call_time + st.read_time) / st.elapsed;
+    st.throughput = st.bytes_in / st.elapsed;
+  }
+  return this->failed ? -1 : 0;
+}
+} // namespace veo
@@ -0,0 +1,84 @@
+/**
+ * @file StreamPipeline.hpp
+ * @brief pipeline streaming host data through a VE function
+ */
+#ifndef _VEO_STREAM_PIPELINE_HPP_
+#define _VEO_STREAM_PIPELINE_HPP_
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <ve_offload.h>
+#include "CallArgs.hpp"
+
+namespace veo {
+class ProcHandle;
+class ThreadContext;
+
+namespace internal {
+/**
+ * @brief queue of slot numbers passed between stages
+ *
+ * A negative number tells the end of the stream.
+ */
+class SlotQueue {
+private:
+  std::mutex mtx;
+  std::condition_variable cond;
+  std::deque<int> queue;
+public:
+  void push(int);
+  int pop();
+};
+} // namespace internal
+
+/**
+ * @brief streaming pipeline
+ *
+ * Data from the source callback are uploaded to a VE input buffer, the VE
+ * function is called to process the buffer into a VE output buffer, and
+ * the output is downloaded and passed to the sink callback. Each stage
+ * runs on its own host thread, rotating "depth" pairs of buffers, so that
+ * the uploading, the function and the downloading of different buffers
+ * run at the same time.
+ */
+class StreamPipeline {
+private:
+  typedef std::chrono::steady_clock clock;
+  /**
+   * @brief a pair of buffers in flight
+   */
+  struct Slot {
+    std::vector<char> hostbuf;//!< staging buffer on VH
+    uint64_t vein;
+    uint64_t veout;
+    size_t in_len;
+    size_t out_len;
+    CallArgs args;
+  };
+  ThreadContext *ctx;
+  ProcHandle *proc;
+  uint64_t addr;
+  size_t in_size;
+  size_t out_size;
+  std::vector<Slot> slots;
+  internal::SlotQueue free_slots, ready_slots, done_slots;
+  std::atomic<bool> failed;
+  veo_stream_stats stats;
+
+  void upload(veo_stream_source, void *);
+  void compute();
+  void download(veo_stream_sink, void *);
+public:
+  StreamPipeline(ThreadContext *, uint64_t, size_t, size_t, int);
+  ~StreamPipeline();
+  StreamPipeline(const StreamPipeline &) = delete;
+
+  int run(veo_stream_source, veo_stream_sink, void *);
+  const veo_stream_stats &getStats() const { return this->stats; }
+};
+} // namespace veo
+#endif
@@ -0,0 +1,169 @@
+/**
+ * @file SymbolTable.cpp
+ * @brief implementation of SymbolTable
+ */
+#include <cerrno>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "SymbolTable.hpp"
+#include "VEOException.hpp"
+#include "log.hpp"
+
+extern "C" {
+/* defined in loader_veo.c */
+int chk_elf_consistency(Elf64_Ehdr *);
+}
+
+namespace veo {
+namespace internal {
+/**
+ * @brief check if a range is within the file image
+ */
+bool in_image(uint64_t offset, uint64_t len, size_t size)
+{
+  return offset <= size && len <= size - offset;
+}
+} // namespace internal
+
+/**
+ * @brief constructor
+ *
+ * @param path path to VE ELF file
+ *
+ * The file is mapped only while the symbol table is built.
+ */
+SymbolTable::SymbolTable(const char *path): anchor_value(0), base(0)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw VEOException("failed to open VE ELF file");
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int saved_errno = errno;
+    ::close(fd);
+    throw VEOException("failed to stat VE ELF file", saved_errno);
+  }
+  size_t size = st.st_size;
+  if (size < sizeof(Elf64_Ehdr)) {
+    ::close(fd);
+    throw VEOException("VE ELF file is too small", ENOEXEC);
+  }
+  void *image = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  int saved_errno = errno;
+  ::close(fd);
+  if (image == MAP_FAILED) {
+    throw VEOException("failed to map VE ELF file", saved_errno);
+  }
+  try {
+    this->parse(static_cast<const char *>(image), size);
+  } catch (...) {
+    munmap(image, size);
+    throw;
+  }
+  munmap(image, size);
+  VEO_DEBUG(nullptr, "%lu symbols in %s (anchor: %s)",
+            this->symbols.size(), path, this->anchor());
+}
+
+/**
+ * @brief read symbols from ELF file image
+ *
+ * @param image ELF file image
+ * @param size size of the image
+ *
+ * Only symbols which the dynamic linker on VE resolves to the definition
+ * in the file are read: undefined, local, hidden, absolute, TLS and
+ * indirect function symbols are left to VE.
+ */
+void SymbolTable::parse(const char *image, size_t size)
+{
+  auto ehdr = reinterpret_cast<const Elf64_Ehdr *>(image);
+  if (chk_elf_consistency(const_cast<Elf64_Ehdr *>(ehdr)) != 0) {
+    throw VEOException("not a VE ELF file", ENOEXEC);
+  }
+  if (ehdr->e_shentsize != sizeof(Elf64_Shdr) ||
+      !internal::in_image(ehdr->e_shoff,
+                          ehdr->e_shnum * sizeof(Elf64_Shdr), size)) {
+    throw VEOException("invalid section header table", ENOEXEC);
+  }
+  auto shdr = reinterpret_cast<const Elf64_Shdr *>(image + ehdr->e_shoff);
+  const Elf64_Shdr *symtab = nullptr;
+  for (int i = 0; i < ehdr->e_shnum; ++i) {
+    if (shdr[i].sh_type == SHT_DYNSYM) {
+      symtab = &shdr[i];
+      break;
+    }
+    if (shdr[i].sh_type == SHT_SYMTAB && symtab == nullptr)
+      symtab = &shdr[i];
+  }
+  if (symtab == nullptr) {
+    throw VEOException("no symbol table", ENOENT);
+  }
+  if (symtab->sh_entsize != sizeof(Elf64_Sym) ||
+      symtab->sh_link >= ehdr->e_shnum ||
+      !internal::in_image(symtab->sh_offset, symtab->sh_size, size)) {
+    throw VEOException("invalid symbol table", ENOEXEC);
+  }
+  auto strtab = &shdr[symtab->sh_link];
+  if (!internal::in_image(strtab->sh_offset, strtab->sh_size, size)) {
+    throw VEOException("invalid string table", ENOEXEC);
+  }
+  auto syms = reinterpret_cast<const Elf64_Sym *>(image + symtab->sh_offset);
+  auto nsyms = symtab->sh_size / sizeof(Elf64_Sym);
+  const char *strs = image + strtab->sh_offset;
+
+  this->symbols.reserve(nsyms);
+  bool anchor_is_global = false;
+  for (size_t i = 1; i < nsyms; ++i) {// entry 0 is always undefined.
+    const auto &sym = syms[i];
+    if (sym.st_shndx == SHN_UNDEF || sym.st_shndx == SHN_ABS ||
+        sym.st_name == 0 || sym.st_name >= strtab->sh_size)
+      continue;
+    auto bind = ELF64_ST_BIND(sym.st_info);
+    if (bind != STB_GLOBAL && bind != STB_WEAK)
+      continue;
+    auto type = ELF64_ST_TYPE(sym.st_info);
+    if (type != STT_FUNC && type != STT_OBJECT && type != STT_NOTYPE)
+      continue;
+    auto vis = ELF64_ST_VISIBILITY(sym.st_other);
+    if (vis == STV_HIDDEN || vis == STV_INTERNAL)
+      continue;
+    const char *name = strs + sym.st_name;
+    auto maxlen = strtab->sh_size - sym.st_name;
+    auto len = strnlen(name, maxlen);
+    if (len == maxlen)
+      continue;// not terminated
+    auto inserted = this->symbols.emplace(std::string(name, len),
+                                          sym.st_value).second;
+    // prefer a global function or object as the anchor.
+    if (inserted && type != STT_NOTYPE && !anchor_is_global) {
+      this->anchor_name.assign(name, len);
+      this->anchor_value = sym.st_value;
+      anchor_is_global = (bind == STB_GLOBAL);
+    }
+  }
+  if (this->anchor_name.empty()) {
+    throw VEOException("no symbols available on VH", ENOENT);
+  }
+}
+
+/**
+ * @brief find a symbol
+ *
+ * @param name symbol name
+ * @return VEMVA of the symbol; zero if the symbol is not in the table.
+ */
+uint64_t SymbolTable::find(const char *name) const
+{
+  auto itr = this->symbols.find(name);
+  if (itr == this->symbols.end())
+    return 0;
+  return this->base + itr->second;
+}
+} // namespace veo
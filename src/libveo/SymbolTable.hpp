@@ -0,0 +1,47 @@
+/**
+ * @file SymbolTable.hpp
+ * @brief symbol table of a VE library parsed on VH
+ */
+#ifndef _VEO_SYMBOL_TABLE_HPP_
+#define _VEO_SYMBOL_TABLE_HPP_
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+
+namespace veo {
+/**
+ * @brief symbols defined in a VE ELF file
+ *
+ * The table is read from .dynsym (or from .symtab if the file has no
+ * .dynsym) on VH. Symbol values are relative to the load base of the
+ * library; the base is determined by resolving the anchor symbol once
+ * on VE and passing its address to setAnchorAddress().
+ */
+class SymbolTable {
+private:
+  std::unordered_map<std::string, uint64_t> symbols;
+  std::string anchor_name;//!< a symbol used to find the load base
+  uint64_t anchor_value;
+  uint64_t base;
+
+  void parse(const char *, size_t);
+public:
+  explicit SymbolTable(const char *);
+  SymbolTable(const SymbolTable &) = delete;
+
+  /**
+   * @brief name of the symbol to be resolved on VE to find the load base
+   */
+  const char *anchor() const { return this->anchor_name.c_str(); }
+  /**
+   * @brief set the load base from VEMVA of the anchor symbol
+   * @param addr VEMVA of the anchor symbol resolved on VE
+   */
+  void setAnchorAddress(uint64_t addr) {
+    this->base = addr - this->anchor_value;
+  }
+  uint64_t find(const char *) const;
+  size_t size() const { return this->symbols.size(); }
+};
+} // namespace veo
+#endif
@@ -6,6 +6,7 @@
 
 #include <pthread.h>
 #include <cerrno>
+#include <cstring>
 #include <semaphore.h>
 #include <signal.h>
 
@@ -91,11 +92,57 @@ void start_child_thread(veos_handle *os_handle, void *arg)
   child_thread_arg *ap = reinterpret_cast<child_thread_arg *>(arg);
   ap->context->startEventLoop(os_handle, ap->semaphore);
 }
+
+/**
+ * @brief check if a system call handler refers to the state of VE process
+ *
+ * @param sysnum system call number
+ * @return true if the handler refers to VEMVA space or thread information
+ *         in global variables of libvepseudo.
+ *
+ * Handlers of these system calls run with the global variables switched
+ * to the VE process. None of them waits for another thread or process;
+ * a handler which can block, e.g., futex() or read() from a pipe, never
+ * holds the switch, since other VE processes would wait for it.
+ * System calls changing signal state, fork() and exit() are filtered.
+ */
+bool needs_proc_state(int sysnum)
+{
+  switch (sysnum) {
+  // VEMVA space
+  case NR_ve_mmap:
+  case NR_ve_munmap:
+  case NR_ve_mprotect:
+  case NR_ve_mremap:
+  case NR_ve_brk:
+  case NR_ve_shmat:
+  case NR_ve_shmdt:
+  case NR_ve_madvise:
+  case NR_ve_msync:
+  case NR_ve_mlock:
+  case NR_ve_munlock:
+  case NR_ve_mlockall:
+  case NR_ve_munlockall:
+  case NR_ve_process_vm_readv:
+  case NR_ve_process_vm_writev:
+  // thread information
+  case NR_ve_clone:
+  case NR_ve_set_tid_address:
+  case NR_ve_set_robust_list:
+  case NR_ve_get_robust_list:
+  case NR_ve_tkill:
+  case NR_ve_tgkill:
+    return true;
+  default:
+    return false;
+  }
+}
 } // namespace internal
 
 ThreadContext::ThreadContext(ProcHandle *p, veos_handle *osh, bool is_main):
   proc(p), os_handle(osh), state(VEO_STATE_UNKNOWN),
-  pseudo_thread(pthread_self()), is_main_thread(is_main), seq_no(0) {}
+  pseudo_thread(pthread_self()), is_main_thread(is_main), seq_no(0),
+  heap_buf(0), heap_size(0), close_reqid(VEO_REQUEST_ID_INVALID) {}
 
 /**
  * @brief handle a single exception from VE process
@@ -144,7 +191,12 @@ int ThreadContext::handleSingleException(uint64_t &exs, SyscallFilter filter)
     } else {
       VEO_DEBUG(this, "syscall %d (to be handled)", sysnum);
       this->state = VEO_STATE_SYSCALL;
-      ve_syscall_handler(this->os_handle, sysnum);
+      if (internal::needs_proc_state(sysnum)) {
+        ProcStateGuard guard(this->proc->procState());
+        ve_syscall_handler(this->os_handle, sysnum);
+      } else {
+        ve_syscall_handler(this->os_handle, sysnum);
+      }
       this->state = VEO_STATE_RUNNING;
     }
   }
@@ -229,10 +281,10 @@ void ThreadContext::_doCall(uint64_t addr, CallArgs &args)
   ve_set_user_reg(this->os_handle, SR12, addr, ~0UL);
   // ve_sp is updated in CallArgs::setup()
   VEO_DEBUG(this, "current stack pointer = %p", (void *)this->ve_sp);
-  args.setup(this->ve_sp);
-  auto regs = args.getRegVal(this->ve_sp);
-  VEO_ASSERT(regs.size() <= NUM_ARGS_ON_REGISTER);
-  for (auto i = 0; i < regs.size(); ++i) {
+  args.setup(this->ve_sp, this->stack_buf, this);
+  uint64_t regs[NUM_ARGS_ON_REGISTER];
+  auto nregs = args.getRegVal(regs);
+  for (auto i = 0; i < nregs; ++i) {
     // set register arguments
     uint64_t regval = regs[i];
     VEO_DEBUG(this, "arg#%d: %#lx", i, regval);
@@ -246,7 +298,7 @@ void ThreadContext::_doCall(uint64_t addr, CallArgs &args)
   VEO_DEBUG(this, "set stack pointer -> %p", (void *)this->ve_sp);
   ve_set_user_reg(this->os_handle, SR11, this->ve_sp, ~0UL);
   VEO_TRACE(this, "unblock (start at %p)", (void *)addr);
-  this->_unBlock(regs.size() > 0 ? regs[0] : 0);
+  this->_unBlock(nregs > 0 ? regs[0] : 0);
 }
 
 /**
@@ -297,6 +349,8 @@ long ThreadContext::handleCloneRequest()
     .semaphore = &child_thread_sem,
   };
   char name[] = "__clone_veo";// the 2nd argument is not const.
+  // the child thread initializes the thread information of the process.
+  ProcStateGuard guard(this->proc->procState());
   auto rv = ve__do_clone(NR_ve_clone, name, this->os_handle,
               &internal::start_child_thread, &arg);
   while (sem_wait(&child_thread_sem) != 0) {
@@ -363,28 +417,65 @@ bool ThreadContext::_executeVE(int &status, uint64_t &exs)
  * @brief event loop
  *
  * Pseudo thread processes commands from request queue while BLOCKED.
+ * The completion of an internal command, which has no valid request ID,
+ * is not pushed to the completion queue.
  */
 void ThreadContext::eventLoop()
 {
   while (this->state == VEO_STATE_BLOCKED) {
     auto command = std::move(this->comq.popRequest());
     auto rv = (*command)();
-    this->comq.pushCompletion(std::move(command));
+    auto id = command->getID();
+    if (id != VEO_REQUEST_ID_INVALID) {
+      this->comq.pushCompletion(std::move(command));
+      this->finishRequest(id);
+    }
     if (rv != 0) {
       VEO_ERROR(this, "Internal error on executing a command(%d)", rv);
       this->state = VEO_STATE_EXIT;
+      this->failLoop();
       return;
     }
   }
 }
 
+/**
+ * @brief event loop after the VE thread can no longer be used
+ *
+ * Pseudo thread fails commands without executing them until the close
+ * command comes, so that waiters of the requests and close() return.
+ */
+void ThreadContext::failLoop()
+{
+  for (;;) {
+    auto command = std::move(this->comq.popRequest());
+    auto id = command->getID();
+    if (id != VEO_REQUEST_ID_INVALID && id == this->close_reqid)
+      (*command)();// never returns.
+    command->setResult(0, VEO_COMMAND_ERROR);
+    if (id != VEO_REQUEST_ID_INVALID) {
+      this->comq.pushCompletion(std::move(command));
+      this->finishRequest(id);
+    }
+  }
+}
+
 /**
  * @brief function to be set to close request (command)
  */
 int64_t ThreadContext::_closeCommandHandler(uint64_t id)
 {
   VEO_TRACE(this, "%s()", __func__);
-  process_thread_cleanup(this->os_handle, -1);
+  // requests queued before close have been executed.
+  try {
+    this->releaseHeapBuffer();
+  } catch (VEOException &e) {
+    VEO_ERROR(this, "failed to free VE buffer for arguments: %s", e.what());
+  }
+  {
+    ProcStateGuard guard(this->proc->procState());
+    process_thread_cleanup(this->os_handle, -1);
+  }
   this->state = VEO_STATE_EXIT;
   /*
    * pthread_exit() can invoke destructors for objects on the stack,
@@ -404,12 +495,17 @@ int64_t ThreadContext::_closeCommandHandler(uint64_t id)
  *
  * @return zero upon success; negative upon failure.
  *
- * Close this VEO thread context; terminate the pseudo thread.
+ * Close this VEO thread context; terminate the transfer lane and the
+ * pseudo thread. The VE buffer for arguments is freed on the pseudo
+ * thread after the requests queued before. A context of which the VE
+ * thread can no longer be used is also closed.
  * The current implementation always returns zero.
  */
 int ThreadContext::close()
 {
+  this->closeTransferLane();
   auto id = this->issueRequestID();
+  this->close_reqid = id;
   auto f = std::bind(&ThreadContext::_closeCommandHandler, this, id);
   std::unique_ptr<Command> req(new internal::CommandImpl(id, f));
   this->comq.pushRequest(std::move(req));
@@ -417,6 +513,146 @@ int ThreadContext::close()
   return c->getRetval();
 }
 
+/**
+ * @brief get the VE heap buffer for large arguments
+ *
+ * @param size size in byte
+ * @return VEMVA of the buffer, valid until the next call; zero upon
+ *         failure.
+ *
+ * The buffer is reused by calls on this context and only grows.
+ */
+uint64_t ThreadContext::heapBuffer(size_t size)
+{
+  if (size > this->heap_size) {
+    try {
+      this->releaseHeapBuffer();
+      this->heap_buf = this->proc->allocBuff(size);
+    } catch (VEOException &e) {
+      VEO_ERROR(this, "failed to allocate VE buffer for arguments: %s",
+                e.what());
+      this->heap_buf = 0;
+    }
+    this->heap_size = this->heap_buf != 0 ? size : 0;
+  }
+  return this->heap_buf;
+}
+
+/**
+ * @brief free the VE heap buffer for large arguments
+ */
+void ThreadContext::releaseHeapBuffer()
+{
+  if (this->heap_buf != 0)
+    this->proc->freeBuff(this->heap_buf);
+  this->heap_buf = 0;
+  this->heap_size = 0;
+}
+
+/**
+ * @brief check if this thread context can be reused
+ *
+ * @return true if the VE thread is blocked and the results of all
+ *         requests have been collected.
+ */
+bool ThreadContext::isIdle()
+{
+  std::lock_guard<std::mutex> lock(this->req_mtx);
+  return this->state == VEO_STATE_BLOCKED && this->rem_reqid.empty();
+}
+
+/**
+ * @brief start a function on VE thread with prepared arguments
+ *
+ * @param addr VEMVA of function called
+ * @param slots register values of arguments
+ * @param n the number of arguments
+ * @param stack_size the size of stack frame for the arguments
+ *
+ * Arguments beyond registers are written in the parameter area from
+ * the stack buffer of this context.
+ */
+void ThreadContext::_doPreparedCall(uint64_t addr,
+                                    const PreparedCall::Slots &slots, int n,
+                                    size_t stack_size)
+{
+  VEO_TRACE(this, "%s(%#lx, _, %d)", __func__, addr, n);
+  ve_set_user_reg(this->os_handle, SR12, addr, ~0UL);
+  for (auto i = 0; i < n && i < NUM_ARGS_ON_REGISTER; ++i) {
+    VEO_DEBUG(this, "arg#%d: %#lx", i, slots[i]);
+    ve_set_user_reg(this->os_handle, SR00 + i, slots[i], ~0UL);
+  }
+  this->ve_sp -= stack_size;
+  if (n > NUM_ARGS_ON_REGISTER) {
+    const size_t regs_end = PARAM_AREA_OFFSET + 8 * NUM_ARGS_ON_REGISTER;
+    auto image = this->stack_buf.get(stack_size);
+    std::memset(image, 0, regs_end);
+    std::memcpy(image + regs_end, &slots[NUM_ARGS_ON_REGISTER],
+                8 * (n - NUM_ARGS_ON_REGISTER));
+    this->_writeMem(this->ve_sp, image, stack_size);
+  }
+  VEO_DEBUG(this, "set stack pointer -> %p", (void *)this->ve_sp);
+  ve_set_user_reg(this->os_handle, SR11, this->ve_sp, ~0UL);
+  this->_unBlock(n > 0 ? slots[0] : 0);
+}
+
+/**
+ * @brief wait for the completion of a function started on VE thread
+ *
+ * @param cmd command to store the result
+ * @return zero upon success; non-zero if the VE thread can no longer be
+ *         used.
+ */
+int64_t ThreadContext::_finishCall(Command *cmd)
+{
+  auto id = cmd->getID();
+  VEO_TRACE(this, "[request #%d] VE execution", id);
+  int status;
+  uint64_t exs;
+  auto successful = this->_executeVE(status, exs);
+  VEO_TRACE(this, "[request #%d] executed.", id);
+  if (!successful) {
+    VEO_ERROR(this, "_executeVE() failed (%d, exs=0x%016lx)", status, exs);
+    if (status == VEO_HANDLER_STATUS_EXCEPTION) {
+      cmd->setResult(exs, VEO_COMMAND_EXCEPTION);
+    } else {
+      cmd->setResult(status, VEO_COMMAND_ERROR);
+    }
+    return 1;
+  }
+  auto rv = this->_collectReturnValue();
+  cmd->setResult(rv, VEO_COMMAND_OK);
+  return 0;
+}
+
+/**
+ * @brief call a VE function and wait for its completion on this context
+ *
+ * @param cmd command to store the result
+ * @param addr VEMVA of VE function to call
+ * @param args arguments of the function
+ * @return zero upon success; non-zero if the VE thread can no longer be
+ *         used.
+ *
+ * This function is to be called on the pseudo thread.
+ */
+int64_t ThreadContext::_execCall(Command *cmd, uint64_t addr, CallArgs &args)
+{
+  auto id = cmd->getID();
+  VEO_TRACE(this, "[request #%d] start...", id);
+  this->_doCall(addr, args);
+  if (this->_finishCall(cmd) != 0)
+    return 1;
+  // post
+  VEO_TRACE(this, "[request #%d] post process", id);
+  auto readmem = std::bind(&ThreadContext::_readMem, this,
+                           std::placeholders::_1, std::placeholders::_2,
+                           std::placeholders::_3);
+  args.copyout(readmem);
+  VEO_TRACE(this, "[request #%d] done", id);
+  return 0;
+}
+
 /**
  * @brief call a VE function asynchronously
  *
@@ -427,33 +663,58 @@ int ThreadContext::close()
 uint64_t ThreadContext::callAsync(uint64_t addr, CallArgs &args)
 {
   auto id = this->issueRequestID();
-  auto f = [&args, this, addr, id] (Command *cmd) {
-    VEO_TRACE(this, "[request #%d] start...", id);
-    this->_doCall(addr, args);
-    VEO_TRACE(this, "[request #%d] VE execution", id);
-    int status;
-    uint64_t exs;
-    auto successful = this->_executeVE(status, exs);
-    VEO_TRACE(this, "[request #%d] executed.", id);
-    if (!successful) {
-      VEO_ERROR(this, "_executeVE() failed (%d, exs=0x%016lx)", status, exs);
-      if (status == VEO_HANDLER_STATUS_EXCEPTION) {
-        cmd->setResult(exs, VEO_COMMAND_EXCEPTION);
-      } else {
-        cmd->setResult(status, VEO_COMMAND_ERROR);
-      }
-      return 1;
-    }
-    auto rv = this->_collectReturnValue();
-    cmd->setResult(rv, VEO_COMMAND_OK);
-    // post
-    VEO_TRACE(this, "[request #%d] post process", id);
-    auto readmem = std::bind(&ThreadContext::_readMem, this,
-                             std::placeholders::_1, std::placeholders::_2,
-                             std::placeholders::_3);
-    args.copyout(readmem);
-    VEO_TRACE(this, "[request #%d] done", id);
-    return 0;
+  auto snap = args.snapshot();
+  auto f = [&args, snap, this, addr] (Command *cmd) {
+    return this->_execCall(cmd, addr, snap ? *snap : args);
+  };
+
+  std::unique_ptr<Command> req(new internal::CommandImpl(id, f));
+  this->comq.pushRequest(std::move(req));
+  return id;
+}
+
+/**
+ * @brief call a VE function asynchronously after requests finish
+ *
+ * @param addr VEMVA of VE function to call
+ * @param args arguments of the function
+ * @param deps requests on this context to finish before the call,
+ *        e.g., transfers on the transfer lane.
+ * @return request ID
+ */
+uint64_t ThreadContext::callAsyncDep(uint64_t addr, CallArgs &args,
+                                     const std::vector<uint64_t> &deps)
+{
+  auto id = this->issueRequestID();
+  auto snap = args.snapshot();
+  auto f = [&args, snap, this, addr, deps] (Command *cmd) {
+    this->waitRequests(deps);
+    return this->_execCall(cmd, addr, snap ? *snap : args);
+  };
+
+  std::unique_ptr<Command> req(new internal::CommandImpl(id, f));
+  this->comq.pushRequest(std::move(req));
+  return id;
+}
+
+/**
+ * @brief call a VE function with prepared arguments asynchronously
+ *
+ * @param addr VEMVA of VE function to call
+ * @param slots register values of arguments, copied into the request
+ * @param n the number of arguments
+ * @param stack_size the size of stack frame for the arguments
+ * @return request ID
+ */
+uint64_t ThreadContext::callPrepared(uint64_t addr,
+                                     const PreparedCall::Slots &slots, int n,
+                                     size_t stack_size)
+{
+  auto id = this->issueRequestID();
+  auto f = [this, addr, slots, n, stack_size] (Command *cmd) {
+    VEO_TRACE(this, "[request #%d] start...", cmd->getID());
+    this->_doPreparedCall(addr, slots, n, stack_size);
+    return this->_finishCall(cmd);
   };
 
   std::unique_ptr<Command> req(new internal::CommandImpl(id, f));
@@ -579,7 +840,7 @@ int ThreadContext::callWaitResult(uint64_t reqid, uint64_t *retp)
  */
 int ThreadContext::_readMem(void *dst, uint64_t src, size_t size)
 {
-  return ve_recv_data(this->os_handle, src, size, dst);
+  return this->proc->hostMem().recv(this->os_handle, dst, src, size);
 }
 
 /**
@@ -591,7 +852,7 @@ int ThreadContext::_readMem(void *dst, uint64_t src, size_t size)
  */
 int ThreadContext::_writeMem(uint64_t dst, const void *src, size_t size)
 {
-  return ve_send_data(this->os_handle, dst, size, const_cast<void *>(src));
+  return this->proc->hostMem().send(this->os_handle, dst, src, size);
 }
 
 
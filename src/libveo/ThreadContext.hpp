@@ -5,9 +5,15 @@
 #ifndef _VEO_THREAD_CONTEXT_HPP_
 #define _VEO_THREAD_CONTEXT_HPP_
 
+#include "CallArgs.hpp"
 #include "Command.hpp"
+#include "PreparedCall.hpp"
+#include "TransferLane.hpp"
+#include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <unordered_set>
+#include <vector>
 #include <pthread.h>
 #include <semaphore.h>
 
@@ -36,6 +42,8 @@ class CallArgs;
  */
 class ThreadContext {
   friend class ProcHandle;// ProcHandle controls the main thread directly.
+  friend class Dispatcher;// Dispatcher runs calls from its own queues.
+  friend class TransferLane;// TransferLane completes requests.
   typedef bool (ThreadContext::*SyscallFilter)(int, int *);
 private:
   pthread_t pseudo_thread;
@@ -47,7 +55,16 @@ private:
   uint64_t seq_no;
   uint64_t ve_sp;
   std::unordered_set<uint64_t> rem_reqid;
+  std::unordered_set<uint64_t> inflight;//!< requests not finished yet
+  std::unordered_set<uint64_t> lane_reqs;//!< requests on the lane not finished
   std::mutex req_mtx;
+  std::condition_variable finish_cond;
+  std::mutex lane_mtx;//!< acquire while lane is referred to
+  std::unique_ptr<TransferLane> lane;
+  StackBuffer stack_buf;//!< stack images of calls on this context
+  uint64_t heap_buf;//!< VE buffer for large arguments of calls
+  size_t heap_size;
+  uint64_t close_reqid;//!< request ID of close command
 
   bool defaultFilter(int, int *);
   bool hookCloneFilter(int, int *);
@@ -74,6 +91,7 @@ private:
   void _unBlock(uint64_t);
   int handleCommand(Command *);
   void eventLoop();
+  void failLoop();
   /**
    * @brief Issue a new request ID
    * @return a request ID, 64 bit integer, to identify a command
@@ -85,10 +103,16 @@ private:
     }
     std::lock_guard<std::mutex> lock(this->req_mtx);
     rem_reqid.insert(ret);
+    inflight.insert(ret);
     return ret;
   }
+  void finishRequest(uint64_t);
+  void waitRequests(const std::vector<uint64_t> &);
   // handlers for commands
   int64_t _closeCommandHandler(uint64_t);
+  int64_t _execCall(Command *, uint64_t, CallArgs &);
+  int64_t _finishCall(Command *);
+  void _doPreparedCall(uint64_t, const PreparedCall::Slots &, int, size_t);
   bool _executeVE(int &, uint64_t &);
   int _readMem(void *, uint64_t, size_t);
   int _writeMem(uint64_t, const void *, size_t);
@@ -102,8 +126,18 @@ public:
   uint64_t callAsyncByName(uint64_t, const char *, CallArgs &);
   int callWaitResult(uint64_t, uint64_t *);
   int callPeekResult(uint64_t, uint64_t *);
-  uint64_t asyncReadMem(void *, uint64_t, size_t);
-  uint64_t asyncWriteMem(uint64_t, const void *, size_t);
+  uint64_t callAsyncDep(uint64_t, CallArgs &, const std::vector<uint64_t> &);
+  uint64_t callPrepared(uint64_t, const PreparedCall::Slots &, int, size_t);
+  uint64_t asyncReadMem(void *, uint64_t, size_t,
+                        const std::vector<uint64_t> &deps = {});
+  uint64_t asyncWriteMem(uint64_t, const void *, size_t,
+                         const std::vector<uint64_t> &deps = {});
+  uint64_t asyncAllocMem(size_t, uint64_t *);
+  uint64_t asyncFreeMem(uint64_t);
+  uint64_t heapBuffer(size_t);
+  void releaseHeapBuffer();
+  void openTransferLane();
+  void closeTransferLane();
 
   /**
    * @brief default exception handler
@@ -123,6 +157,8 @@ public:
     return reinterpret_cast<veo_thr_ctxt *>(this);
   }
   bool isMainThread() { return this->is_main_thread;}
+  ProcHandle *procHandle() { return this->proc; }
+  bool isIdle();
   int close();
 
 };
@@ -0,0 +1,104 @@
+/**
+ * @file TransferLane.cpp
+ * @brief implementation of TransferLane
+ */
+#include <cerrno>
+#include <signal.h>
+
+/* VE OS internal headers */
+extern "C" {
+#include "handle.h"
+}
+
+#include "TransferLane.hpp"
+#include "ThreadContext.hpp"
+#include "ProcHandle.hpp"
+#include "CommandImpl.hpp"
+#include "VEOException.hpp"
+#include "log.hpp"
+
+namespace veo {
+/**
+ * @brief constructor
+ *
+ * @param c VEO context served by the lane
+ * @param parent VEOS handle of the context
+ *
+ * The lane opens a new VEOS handle derived from the handle of the
+ * context.
+ */
+TransferLane::TransferLane(ThreadContext *c, veos_handle *parent): ctx(c)
+{
+  this->os_handle = veos_handle_create(parent->device_name,
+                                       parent->veos_sock_name, parent, -1);
+  if (this->os_handle == nullptr) {
+    throw VEOException("failed to create VEOS handle for transfer lane",
+                       errno != 0 ? errno : EAGAIN);
+  }
+  try {
+    this->thread = std::thread(&TransferLane::run, this);
+  } catch (std::system_error &e) {
+    veos_handle_free(this->os_handle);
+    throw VEOException("failed to start transfer lane", e.code().value());
+  }
+  VEO_DEBUG(c, "transfer lane %p is opened", this);
+}
+
+/**
+ * @brief destructor
+ *
+ * Transfers already requested are finished before the lane is closed.
+ */
+TransferLane::~TransferLane()
+{
+  auto stop = [](Command *) -> int64_t { return 0; };
+  this->push(std::unique_ptr<Command>(
+    new internal::CommandImpl(VEO_REQUEST_ID_INVALID, stop)));
+  this->thread.join();
+  veos_handle_free(this->os_handle);
+  VEO_DEBUG(this->ctx, "transfer lane %p is closed", this);
+}
+
+/**
+ * @brief thread serving transfers until a command without request ID
+ */
+void TransferLane::run()
+{
+  // transfer lanes never handle signals as pseudo threads of contexts.
+  sigset_t sigmask;
+  sigfillset(&sigmask);
+  pthread_sigmask(SIG_BLOCK, &sigmask, NULL);
+  for (;;) {
+    auto command = this->queue.pop();
+    auto id = command->getID();
+    if (id == VEO_REQUEST_ID_INVALID)
+      break;
+    (*command)();
+    this->ctx->comq.pushCompletion(std::move(command));
+    this->ctx->finishRequest(id);
+  }
+}
+
+void TransferLane::push(std::unique_ptr<Command> cmd)
+{
+  this->queue.push(std::move(cmd));
+}
+
+/**
+ * @brief read data from VE memory through the handle of the lane
+ */
+int TransferLane::readMem(void *dst, uint64_t src, size_t size)
+{
+  auto &host_mem = this->ctx->procHandle()->hostMem();
+  return host_mem.recv(this->os_handle, dst, src, size);
+}
+
+/**
+ * @brief write data to VE memory through the handle of the lane
+ */
+int TransferLane::writeMem(uint64_t dst, const void *src, size_t size)
+{
+  auto &host_mem = this->ctx->procHandle()->hostMem();
+  return host_mem.send(this->os_handle, dst, src, size);
+}
+} // namespace veo
@@ -0,0 +1,46 @@
+/**
+ * @file TransferLane.hpp
+ * @brief transfer-only pseudo thread of a VEO context
+ */
+#ifndef _VEO_TRANSFER_LANE_HPP_
+#define _VEO_TRANSFER_LANE_HPP_
+#include <memory>
+#include <thread>
+
+#include "Command.hpp"
+
+extern "C" {
+#include <libvepseudo.h>
+}
+
+namespace veo {
+class ThreadContext;
+
+/**
+ * @brief transfer lane
+ *
+ * A transfer lane serves memory transfers of a VEO context on its own
+ * thread with its own VEOS handle, so that transfers run while the VE
+ * thread of the context is executing a function. Transfers on a lane are
+ * not ordered with calls on the context; the order is to be specified
+ * by dependencies of requests.
+ */
+class TransferLane {
+private:
+  ThreadContext *ctx;
+  veos_handle *os_handle;
+  BlockingQueue queue;
+  std::thread thread;
+
+  void run();
+public:
+  TransferLane(ThreadContext *, veos_handle *);
+  ~TransferLane();
+  TransferLane(const TransferLane &) = delete;
+
+  void push(std::unique_ptr<Command>);
+  int readMem(void *, uint64_t, size_t);
+  int writeMem(uint64_t, const void *, size_t);
+};
+} // namespace veo
+#endif
@@ -41,8 +41,17 @@
 #include <config.h>
 #include <cstdio>
 #include <cstdlib>
+#include <new>
+#include <system_error>
+#include <vector>
 #include "CallArgs.hpp"
+#include "ContextGroup.hpp"
+#include "Dispatcher.hpp"
+#include "ProcFuture.hpp"
 #include "ProcHandle.hpp"
+#include "PreparedCall.hpp"
+#include "ProcPool.hpp"
+#include "StreamPipeline.hpp"
 #include "VEOException.hpp"
 #include "log.hpp"
 
@@ -61,6 +70,43 @@ CallArgs *CallArgsFromC(veo_args *a)
 {
   return reinterpret_cast<CallArgs *>(a);
 }
+ProcPool *ProcPoolFromC(veo_proc_pool *p)
+{
+  return reinterpret_cast<ProcPool *>(p);
+}
+ProcFuture *ProcFutureFromC(veo_proc_future *f)
+{
+  return reinterpret_cast<ProcFuture *>(f);
+}
+ContextGroup *ContextGroupFromC(veo_ctxt_group *g)
+{
+  return reinterpret_cast<ContextGroup *>(g);
+}
+PreparedCall *PreparedCallFromC(veo_prepared_call *c)
+{
+  return reinterpret_cast<PreparedCall *>(c);
+}
+
+/**
+ * @brief paths to VE device file and VE OS socket of a VE node
+ */
+struct NodePath {
+  char vedev[16];// the size of "/dev/veslot" = 12.
+  char ossock[sizeof(VEOS_SOCKET) + 16];
+  explicit NodePath(int venode) {
+    snprintf(vedev, sizeof(vedev), VE_DEV, venode);
+    snprintf(ossock, sizeof(ossock), VEOS_SOCKET, venode);
+  }
+};
+
+/**
+ * @brief the default veorun binary
+ */
+const char *default_veorun_bin()
+{
+  const char *veobin = getenv("VEORUN_BIN");
+  return veobin != nullptr ? veobin : VEORUN_BIN;
+}
 
 template <typename T> int veo_args_set_(veo_args *ca, int argnum, T val)
 {
@@ -73,13 +119,33 @@ template <typename T> int veo_args_set_(veo_args *ca, int argnum, T val)
     return -1;
   }
 }
+
+template <typename T> int veo_prepared_set_(veo_prepared_call *pc,
+  int argnum, void (PreparedCall::*setter)(int, T), T val)
+{
+  try {
+    (PreparedCallFromC(pc)->*setter)(argnum, val);
+    return 0;
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "failed to set the prepared argument #%d: %s",
+              argnum, e.what());
+    errno = e.err();
+    return -1;
+  }
+}
 } // namespace veo::api
 } // namespace veo
 
 using veo::api::ProcHandleFromC;
 using veo::api::ThreadContextFromC;
 using veo::api::CallArgsFromC;
+using veo::api::ProcPoolFromC;
+using veo::api::ProcFutureFromC;
+using veo::api::ContextGroupFromC;
+using veo::api::PreparedCallFromC;
+using veo::api::NodePath;
 using veo::api::veo_args_set_;
+using veo::api::veo_prepared_set_;
 using veo::VEOException;
 
 // implementation of VEO API functions
@@ -131,11 +197,8 @@ veo_proc_handle *veo_proc__create(const char *ossock, const char *vedev,
  */
 veo_proc_handle *veo_proc_create_static(int venode, const char *veobin)
 {
-  char vedev[16];// the size of "/dev/veslot" = 12.
-  snprintf(vedev, sizeof(vedev), VE_DEV, venode);
-  char ossock[sizeof(VEOS_SOCKET) + 16];
-  snprintf(ossock, sizeof(ossock), VEOS_SOCKET, venode);
-  return veo_proc__create(ossock, vedev, veobin);
+  NodePath path(venode);
+  return veo_proc__create(path.ossock, path.vedev, veobin);
 }
  
 /**
@@ -144,14 +207,234 @@ veo_proc_handle *veo_proc_create_static(int venode, const char *veobin)
  * @param venode VE node number
  * @return pointer to VEO process handle upon success
  * @retval NULL VE process creation failed.
+ *
+ * Libraries listed in the environment variable VEO_PRELOAD_LIBS,
+ * separated by colons, are loaded on creation of the VE process.
  */
 veo_proc_handle *veo_proc_create(int venode)
 {
-  const char *veobin = getenv("VEORUN_BIN");
-  if (veobin != nullptr)
-    return veo_proc_create_static(venode, veobin);
-  else
-    return veo_proc_create_static(venode, VEORUN_BIN);
+  return veo_proc_create_static(venode, veo::api::default_veorun_bin());
+}
+
+/**
+ * @brief start creating a VE process asynchronously
+ *
+ * @param venode VE node number
+ * @return pointer to the future of VEO process handle upon success
+ * @retval NULL VE process creation failed to start.
+ *
+ * The VE process is created on another host thread; the caller can
+ * continue its own initialization and obtain the process by
+ * veo_proc_future_wait().
+ */
+veo_proc_future *veo_proc_create_async(int venode)
+{
+  NodePath path(venode);
+  try {
+    auto rv = new veo::ProcFuture(path.ossock, path.vedev,
+                                  veo::api::default_veorun_bin());
+    return rv->toCHandle();
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "failed to create ProcFuture: %s", e.what());
+    errno = e.err();
+    return NULL;
+  } catch (std::bad_alloc &e) {
+    errno = ENOMEM;
+    return NULL;
+  }
+}
+
+/**
+ * @brief wait for the creation of a VE process
+ *
+ * @param future the future returned by veo_proc_create_async()
+ * @return pointer to VEO process handle upon success
+ * @retval NULL VE process creation failed.
+ *
+ * The future is freed and cannot be used after this function returns.
+ */
+veo_proc_handle *veo_proc_future_wait(veo_proc_future *future)
+{
+  auto f = ProcFutureFromC(future);
+  veo_proc_handle *rv = NULL;
+  try {
+    rv = f->get()->toCHandle();
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "failed to create ProcHandle: %s", e.what());
+    errno = e.err();
+  } catch (std::system_error &e) {
+    VEO_ERROR(nullptr, "failed to create ProcHandle: %s", e.what());
+    errno = e.code().value();
+  } catch (...) {
+    // e.g., std::bad_alloc in the thread creating the process
+    VEO_ERROR(nullptr, "failed to create ProcHandle: %s", "unknown exception");
+    errno = ENOMEM;
+  }
+  delete f;
+  return rv;
+}
+
+/**
+ * @brief create VE processes on VE nodes concurrently
+ *
+ * @param venodes array of VE node numbers
+ * @param n the number of VE processes to create
+ * @param[out] procs array of n VEO process handles;
+ *             NULL is set for a process failed to be created.
+ * @retval 0 all VE processes are created.
+ * @retval -1 creation of one or more VE processes failed, or n is not
+ *         positive (errno = EINVAL).
+ *
+ * The same VE node can appear more than once to create more than one
+ * VE process on the node.
+ */
+int veo_proc_create_many(const int *venodes, int n, veo_proc_handle **procs)
+{
+  if (n <= 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  int rv = 0;
+  std::vector<veo_proc_future *> futures(n);
+  for (int i = 0; i < n; ++i) {
+    futures[i] = veo_proc_create_async(venodes[i]);
+  }
+  for (int i = 0; i < n; ++i) {
+    procs[i] = futures[i] != NULL ? veo_proc_future_wait(futures[i]) : NULL;
+    if (procs[i] == NULL)
+      rv = -1;
+  }
+  return rv;
+}
+
+/**
+ * @brief get the elapsed time of each phase of VE process creation
+ *
+ * @param proc VEO process handle
+ * @param[out] times array to store the elapsed time of phases in seconds,
+ *             indexed by enum veo_startup_phase
+ * @param n the number of elements of times
+ * @return the number of phases, VEO_STARTUP_NUM_PHASES.
+ *
+ * At most n elements are stored.
+ */
+int veo_proc_get_startup_time(veo_proc_handle *proc, double *times, int n)
+{
+  auto &prof = ProcHandleFromC(proc)->startupProfile();
+  for (int i = 0; i < n && i < VEO_STARTUP_NUM_PHASES; ++i)
+    times[i] = prof.get(i);
+  return VEO_STARTUP_NUM_PHASES;
+}
+
+/**
+ * @brief dump the elapsed time of VE process creation in JSON
+ *
+ * @param proc VEO process handle
+ * @param buf buffer to store the JSON object
+ * @param len size of buf
+ * @return the length of the JSON object, excluding the terminating null
+ *         byte. If the return value is len or more, the output is
+ *         truncated, as snprintf().
+ *
+ * The JSON object has the elapsed time of each phase and "total"
+ * in seconds.
+ */
+int veo_proc_dump_startup_json(veo_proc_handle *proc, char *buf, size_t len)
+{
+  return ProcHandleFromC(proc)->startupProfile().toJSON(buf, len);
+}
+
+/**
+ * @brief create a pool of VE processes
+ *
+ * @param venode VE node number
+ * @param n the number of VE processes created in advance
+ * @param veobin VE alternative veorun binary path;
+ *        NULL to use the same binary as veo_proc_create().
+ * @return pointer to VEO process pool upon success
+ * @retval NULL VE process pool creation failed.
+ *
+ * All processes in a pool are created on creation of the pool, including
+ * the initialization of VE libc, the worker context and libraries listed
+ * in VEO_PRELOAD_LIBS; veo_proc_pool_acquire() returns a process
+ * immediately.
+ */
+veo_proc_pool *veo_proc_pool_create(int venode, int n, const char *veobin)
+{
+  NodePath path(venode);
+  if (veobin == nullptr)
+    veobin = veo::api::default_veorun_bin();
+  try {
+    auto rv = new veo::ProcPool(path.ossock, path.vedev, veobin, n);
+    return rv->toCHandle();
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "failed to create ProcPool: %s", e.what());
+    errno = e.err();
+    return NULL;
+  }
+}
+
+/**
+ * @brief acquire a VE process from a pool
+ *
+ * @param pool VEO process pool
+ * @return pointer to VEO process handle upon success
+ * @retval NULL VE process creation failed.
+ *
+ * If no process is idle in the pool, a new VE process is created and
+ * added to the pool.
+ */
+veo_proc_handle *veo_proc_pool_acquire(veo_proc_pool *pool)
+{
+  try {
+    return ProcPoolFromC(pool)->acquire()->toCHandle();
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "failed to acquire a process: %s", e.what());
+    errno = e.err();
+    return NULL;
+  }
+}
+
+/**
+ * @brief release a VE process to a pool
+ *
+ * @param pool VEO process pool
+ * @param proc VEO process handle acquired from the pool
+ * @retval 0 the process is reset and returned to the pool.
+ * @retval -1 the process failed to be reset or not acquired from the pool.
+ *
+ * VEO contexts left opened, the dispatcher contexts, VE memory buffers
+ * and host memory registrations are released, and the striping is set
+ * back to the default. No call or transfer may be in flight. A process
+ * failed to be reset is terminated and destroyed.
+ */
+int veo_proc_pool_release(veo_proc_pool *pool, veo_proc_handle *proc)
+{
+  try {
+    ProcPoolFromC(pool)->release(ProcHandleFromC(proc));
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "failed to release a process: %s", e.what());
+    errno = e.err();
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief destroy a pool of VE processes
+ *
+ * @param pool VEO process pool
+ * @retval 0 all VE processes in the pool are terminated.
+ * @retval positive the number of processes still acquired.
+ *         The processes are not terminated; destroy them by
+ *         veo_proc_destroy().
+ */
+int veo_proc_pool_destroy(veo_proc_pool *pool)
+{
+  auto p = ProcPoolFromC(pool);
+  int rv = p->destroy();
+  delete p;
+  return rv;
 }
 
 /**
@@ -176,6 +459,9 @@ int veo_proc_destroy(veo_proc_handle *proc)
  * @param libname a library file name to load
  * @return a handle for the library
  * @retval 0 library loading request failed.
+ *
+ * Loading a library already loaded, including a library preloaded by
+ * VEO_PRELOAD_LIBS, returns the same handle without a request to VE.
  */
 uint64_t veo_load_library(veo_proc_handle *proc, const char *libname)
 {
@@ -228,12 +514,66 @@ veo_thr_ctxt *veo_context_open(veo_proc_handle *proc)
   }
 }
 
+/**
+ * @brief open VEO contexts
+ *
+ * @param proc VEO process handle
+ * @param n the number of VEO contexts to open
+ * @param[out] ctxs array to store n pointers to VEO thread contexts
+ * @retval 0 all VEO contexts are opened.
+ * @retval -1 failed to open VEO contexts; no context is opened.
+ *
+ * Contexts closed before are reused first; the rest are created on VE
+ * one after another without a round trip for each context.
+ */
+int veo_context_open_many(veo_proc_handle *proc, int n, veo_thr_ctxt **ctxs)
+{
+  try {
+    auto c = reinterpret_cast<veo::ThreadContext **>(ctxs);
+    ProcHandleFromC(proc)->openContexts(n, c);
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "failed to open contexts: %s", e.what());
+    errno = e.err();
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief open a transfer lane of a VEO context
+ *
+ * @param ctx VEO context
+ * @retval 0 the transfer lane is opened.
+ * @retval -1 failed to open the transfer lane; transfers on the context
+ *         are served by the context as before.
+ *
+ * Asynchronous transfers on a context with a transfer lane are served
+ * by a thread with its own VEOS handle while the VE thread of the context
+ * is executing a function. They are no longer ordered with calls; use
+ * veo_call_async_dep(), veo_async_read_mem_dep() and
+ * veo_async_write_mem_dep() to order them.
+ */
+int veo_context_open_transfer_lane(veo_thr_ctxt *ctx)
+{
+  try {
+    ThreadContextFromC(ctx)->openTransferLane();
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "failed to open transfer lane: %s", e.what());
+    errno = e.err();
+    return -1;
+  }
+  return 0;
+}
+
 /**
  * @brief close a VEO context
  *
  * @param ctx a VEO context to close
  * @retval 0 VEO context is successfully closed.
  * @retval non-zero failed to close VEO context.
+ *
+ * The VE thread of a context closed after all results are collected
+ * is kept in the process and reused by veo_context_open().
  */
 int veo_context_close(veo_thr_ctxt *ctx)
 {
@@ -242,10 +582,93 @@ int veo_context_close(veo_thr_ctxt *ctx)
     VEO_ERROR(c, "DO NOT close the main thread %p", c);
     return -EINVAL;
   }
-  int rv = c->close();
-  if (rv == 0) {
-    delete c;
+  return c->procHandle()->closeContext(c);
+}
+
+/**
+ * @brief open a group of VEO contexts
+ *
+ * @param proc VEO process handle
+ * @param n the number of VEO contexts to open
+ * @return pointer to the context group upon success
+ * @retval NULL failed to open VEO contexts.
+ */
+veo_ctxt_group *veo_ctxt_group_open(veo_proc_handle *proc, int n)
+{
+  try {
+    auto rv = new veo::ContextGroup(ProcHandleFromC(proc), n);
+    return rv->toCHandle();
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "failed to open context group: %s", e.what());
+    errno = e.err();
+    return NULL;
+  }
+}
+
+/**
+ * @brief create a group of VEO contexts already opened
+ *
+ * @param ctxs array of VEO contexts of the same process;
+ *        the index is the rank in the group.
+ * @param n the number of VEO contexts
+ * @return pointer to the context group upon success
+ * @retval NULL the contexts are invalid.
+ *
+ * The contexts are not closed by veo_ctxt_group_close().
+ */
+veo_ctxt_group *veo_ctxt_group_create(veo_thr_ctxt **ctxs, int n)
+{
+  try {
+    auto c = reinterpret_cast<veo::ThreadContext **>(ctxs);
+    auto rv = new veo::ContextGroup(c, n);
+    return rv->toCHandle();
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "failed to create context group: %s", e.what());
+    errno = e.err();
+    return NULL;
+  }
+}
+
+/**
+ * @brief get the number of VEO contexts in a group
+ */
+int veo_ctxt_group_size(veo_ctxt_group *group)
+{
+  return ContextGroupFromC(group)->size();
+}
+
+/**
+ * @brief get a VEO context in a group
+ *
+ * @param group VEO context group
+ * @param rank rank of the VEO context
+ * @return pointer to VEO context
+ * @retval NULL rank is out of range.
+ */
+veo_thr_ctxt *veo_ctxt_group_get(veo_ctxt_group *group, int rank)
+{
+  try {
+    return ContextGroupFromC(group)->get(rank)->toCHandle();
+  } catch (VEOException &e) {
+    errno = e.err();
+    return NULL;
   }
+}
+
+/**
+ * @brief close a group of VEO contexts
+ *
+ * @param group VEO context group
+ * @retval 0 the group is closed.
+ * @retval non-zero failed to close VEO contexts.
+ *
+ * VEO contexts opened by veo_ctxt_group_open() are closed.
+ */
+int veo_ctxt_group_close(veo_ctxt_group *group)
+{
+  auto g = ContextGroupFromC(group);
+  int rv = g->close();
+  delete g;
   return rv;
 }
 
@@ -281,6 +704,29 @@ uint64_t veo_call_async(veo_thr_ctxt *ctx, uint64_t addr, veo_args *args)
   }
 }
 
+/**
+ * @brief request a VE thread to call a function after requests finish
+ *
+ * @param ctx VEO context to execute the function on VE.
+ * @param addr VEMVA of the function to call
+ * @param args arguments to be passed to the function
+ * @param deps IDs of requests on the context to finish before the call
+ * @param ndeps the number of IDs in deps
+ * @return request ID
+ * @retval VEO_REQUEST_ID_INVALID request failed.
+ */
+uint64_t veo_call_async_dep(veo_thr_ctxt *ctx, uint64_t addr, veo_args *args,
+                            const uint64_t *deps, int ndeps)
+{
+  try {
+    std::vector<uint64_t> d(deps, deps + (ndeps > 0 ? ndeps : 0));
+    return ThreadContextFromC(ctx)->callAsyncDep(addr, *CallArgsFromC(args),
+                                                 d);
+  } catch (VEOException &e) {
+    return VEO_REQUEST_ID_INVALID;
+  }
+}
+
 /**
  * @brief request a VE thread to call a function
  *
@@ -343,34 +789,337 @@ int veo_call_wait_result(veo_thr_ctxt *ctx, uint64_t reqid, uint64_t *retp)
 }
 
 /**
- * @brief Allocate a VE memory buffer
+ * @brief call a function on all VEO contexts of a group
  *
- * @param h VEO process handle
- * @param addr [out] VEMVA address
- * @param size [in] size in bytes
- * @retval 0 memory allocation succeeded.
- * @retval -1 memory allocation failed.
- * @retval -2 internal error.
+ * @param group VEO context group
+ * @param addr VEMVA of the function to call
+ * @param builder callback to set arguments for each rank; NULL if the
+ *        function takes only the rank and the size.
+ * @param data pointer passed to builder
+ * @return request ID of the group
+ * @retval VEO_REQUEST_ID_INVALID request failed.
+ *
+ * The function is called with the rank of the context as the argument #0
+ * and the size of the group as #1. builder is called for each rank before
+ * any call starts; it sets the argument #2 and later.
  */
-int veo_alloc_mem(veo_proc_handle *h, uint64_t *addr, const size_t size)
+uint64_t veo_call_all(veo_ctxt_group *group, uint64_t addr,
+                      veo_args_builder builder, void *data)
 {
   try {
-    *addr = ProcHandleFromC(h)->allocBuff(size);
-    if (*addr == 0UL)
-      return -1;
+    return ContextGroupFromC(group)->callAll(addr, builder, data);
   } catch (VEOException &e) {
-    return -2;
+    VEO_ERROR(nullptr, "failed to call on group: %s", e.what());
+    return VEO_REQUEST_ID_INVALID;
   }
-  return 0;
 }
 
 /**
- * @brief Free a VE memory buffer
+ * @brief pick up results of a call on a group if all have finished
  *
- * @param h VEO process handle
- * @param addr [in] VEMVA address
- * @retval 0 memory is successfully freed.
- * @retval -1 internal error.
+ * @param group VEO context group
+ * @param reqid request ID of the group
+ * @param[out] retvals array to store return values of each rank;
+ *             can be NULL.
+ * @retval VEO_COMMAND_OK the function returned on all contexts.
+ * @retval VEO_COMMAND_EXCEPTION an exception occurred on a context.
+ * @retval VEO_COMMAND_ERROR an error occurred on a context.
+ * @retval VEO_COMMAND_UNFINISHED the function is not finished on a context.
+ *
+ * The status of the first failed rank is returned.
+ */
+int veo_call_all_peek_result(veo_ctxt_group *group, uint64_t reqid,
+                             uint64_t *retvals)
+{
+  return ContextGroupFromC(group)->peekResult(reqid, retvals);
+}
+
+/**
+ * @brief wait for a call on a group to finish on all contexts
+ *
+ * @param group VEO context group
+ * @param reqid request ID of the group
+ * @param[out] retvals array to store return values of each rank;
+ *             can be NULL.
+ * @retval VEO_COMMAND_OK the function returned on all contexts.
+ * @retval VEO_COMMAND_EXCEPTION an exception occurred on a context.
+ * @retval VEO_COMMAND_ERROR an error occurred on a context.
+ */
+int veo_call_all_wait_result(veo_ctxt_group *group, uint64_t reqid,
+                             uint64_t *retvals)
+{
+  return ContextGroupFromC(group)->waitResult(reqid, retvals);
+}
+
+/**
+ * @brief run a function over an index range on VEO contexts of a group
+ *
+ * @param group VEO context group
+ * @param addr VEMVA of the function
+ * @param begin the first index of the range
+ * @param end the last index of the range + 1
+ * @param grain the number of indices in a chunk
+ * @param bufs host buffers indexed by the range; the element of index
+ *        begin is at the start of each buffer.
+ * @param nbufs the number of host buffers
+ * @retval 0 the function succeeded on all chunks.
+ * @retval -1 the function or data transfer failed.
+ *
+ * [begin, end) is split into chunks of grain indices; a context takes
+ * the next chunk when it becomes ready. For each chunk, the part of
+ * each IN or INOUT buffer is uploaded to a VE buffer, the function is
+ * called as func(chunk_begin, chunk_len, vebuf_0, ..., vebuf_{nbufs-1}),
+ * and the part of each OUT or INOUT buffer is downloaded. The function
+ * on VE returns zero upon success. Two chunks are in flight on each
+ * context so that transfers overlap the computation.
+ */
+int veo_parallel_for(veo_ctxt_group *group, uint64_t addr, size_t begin,
+                     size_t end, size_t grain, const struct veo_pfor_buf *bufs,
+                     int nbufs)
+{
+  try {
+    return ContextGroupFromC(group)->parallelFor(addr, begin, end, grain,
+                                                 bufs, nbufs);
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "parallel for failed: %s", e.what());
+    errno = e.err();
+    return -1;
+  }
+}
+
+/**
+ * @brief stream data through a VE function
+ *
+ * @param ctx VEO context to call the function on
+ * @param addr VEMVA of the function
+ * @param in_size size of an input buffer
+ * @param out_size size of an output buffer
+ * @param depth the number of buffers in flight
+ * @param source callback to fill an input buffer
+ * @param sink callback to consume an output buffer; can be NULL.
+ * @param data pointer passed to the callbacks
+ * @param[out] stats statistics of the run; can be NULL.
+ * @retval 0 the stream is processed until the source ends.
+ * @retval -1 an error occurred.
+ *
+ * The function is called as func(in, in_len, out, out_size) for each
+ * buffer filled by the source and returns the size of the output, which
+ * is passed to the sink in order. Uploading, the function and downloading
+ * of different buffers run at the same time on depth pairs of VE buffers.
+ */
+int veo_stream_run(veo_thr_ctxt *ctx, uint64_t addr, size_t in_size,
+                   size_t out_size, int depth, veo_stream_source source,
+                   veo_stream_sink sink, void *data,
+                   struct veo_stream_stats *stats)
+{
+  try {
+    if (source == nullptr) {
+      throw VEOException("no source", EINVAL);
+    }
+    veo::StreamPipeline pipeline(ThreadContextFromC(ctx), addr, in_size,
+                                 out_size, depth);
+    auto rv = pipeline.run(source, sink, data);
+    if (stats != nullptr)
+      *stats = pipeline.getStats();
+    return rv;
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "stream failed: %s", e.what());
+    errno = e.err();
+    return -1;
+  }
+}
+
+/**
+ * @brief add VEO contexts to the dispatcher of a VE process
+ *
+ * @param proc VEO process handle
+ * @param n the number of VEO contexts to open for the dispatcher
+ * @retval 0 VEO contexts are added.
+ * @retval -1 failed to open VEO contexts.
+ *
+ * Calls by veo_proc_call_async() are scheduled on the contexts owned by
+ * the dispatcher.
+ */
+int veo_proc_dispatch_open(veo_proc_handle *proc, int n)
+{
+  try {
+    ProcHandleFromC(proc)->getDispatcher()->addContexts(n);
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "failed to open contexts: %s", e.what());
+    errno = e.err();
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief request a VE process to call a function on any context
+ *
+ * @param proc VEO process handle
+ * @param addr VEMVA of the function to call
+ * @param args arguments to be passed to the function
+ * @return request ID
+ * @retval VEO_REQUEST_ID_INVALID request failed.
+ *
+ * The call is queued to the least loaded context of the dispatcher;
+ * a context which becomes idle steals calls queued to the others.
+ * A context is opened if the dispatcher has no context.
+ *
+ * The context executing the call is not known when it is submitted, so
+ * the request ID is issued by the dispatcher of the process, not by a
+ * context. It is waitable only by veo_proc_call_wait_result() or
+ * veo_proc_call_peek_result(); it must not be passed to
+ * veo_call_wait_result(), veo_call_peek_result() or as a dependency of
+ * the *_dep functions.
+ */
+uint64_t veo_proc_call_async(veo_proc_handle *proc, uint64_t addr,
+                             veo_args *args)
+{
+  try {
+    return ProcHandleFromC(proc)->getDispatcher()->submit(addr,
+             *CallArgsFromC(args));
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "failed to submit a call: %s", e.what());
+    return VEO_REQUEST_ID_INVALID;
+  }
+}
+
+/**
+ * @brief request a VE process to call a function on any context
+ *
+ * @param proc VEO process handle
+ * @param libhdl a library handle
+ * @param symname symbol name to find
+ * @param args arguments to be passed to the function
+ * @return request ID
+ * @retval VEO_REQUEST_ID_INVALID request failed.
+ */
+uint64_t veo_proc_call_async_by_name(veo_proc_handle *proc, uint64_t libhdl,
+                                     const char *symname, veo_args *args)
+{
+  try {
+    auto p = ProcHandleFromC(proc);
+    auto addr = p->getSym(libhdl, symname);
+    if (addr == 0)
+      return VEO_REQUEST_ID_INVALID;
+    return p->getDispatcher()->submit(addr, *CallArgsFromC(args));
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "failed to submit a call: %s", e.what());
+    return VEO_REQUEST_ID_INVALID;
+  }
+}
+
+/**
+ * @brief pick up a result of a call by veo_proc_call_async() if finished
+ *
+ * @param proc VEO process handle
+ * @param reqid request ID
+ * @param retp pointer to buffer to store the return value from the function.
+ * @retval VEO_COMMAND_OK function is successfully returned.
+ * @retval VEO_COMMAND_EXCEPTION an exception occurred on function.
+ * @retval VEO_COMMAND_ERROR an error occurred on function.
+ * @retval VEO_COMMAND_UNFINISHED function is not finished.
+ */
+int veo_proc_call_peek_result(veo_proc_handle *proc, uint64_t reqid,
+                              uint64_t *retp)
+{
+  return ProcHandleFromC(proc)->getDispatcher()->peekResult(reqid, retp);
+}
+
+/**
+ * @brief pick up a result of a call by veo_proc_call_async()
+ *
+ * @param proc VEO process handle
+ * @param reqid request ID
+ * @param retp pointer to buffer to store the return value from the function.
+ * @retval VEO_COMMAND_OK function is successfully returned.
+ * @retval VEO_COMMAND_EXCEPTION an exception occurred on execution.
+ * @retval VEO_COMMAND_ERROR an error occurred on execution.
+ */
+int veo_proc_call_wait_result(veo_proc_handle *proc, uint64_t reqid,
+                              uint64_t *retp)
+{
+  return ProcHandleFromC(proc)->getDispatcher()->waitResult(reqid, retp);
+}
+
+/**
+ * @brief get utilization of contexts of the dispatcher
+ *
+ * @param proc VEO process handle
+ * @param[out] stats array to store statistics of contexts
+ * @param n the number of elements of stats
+ * @return the number of contexts owned by the dispatcher.
+ *
+ * At most n elements are stored.
+ */
+int veo_proc_dispatch_get_stats(veo_proc_handle *proc,
+                                struct veo_dispatch_stats *stats, int n)
+{
+  return ProcHandleFromC(proc)->getDispatcher()->getStats(stats, n);
+}
+
+/**
+ * @brief enable or disable elastic scaling of contexts of the dispatcher
+ *
+ * @param proc VEO process handle
+ * @param conf parameters of scaling; NULL to disable scaling.
+ * @retval 0 the parameters are applied.
+ * @retval -1 the parameters are invalid.
+ *
+ * Every conf->interval seconds, a context is opened if the calls queued
+ * exceed conf->queue_depth per context or the oldest call waits longer
+ * than conf->wait_time, up to conf->max_contexts; a context idle longer
+ * than conf->idle_time is closed, down to conf->min_contexts. Zero
+ * disables each threshold. Contexts closed by scaling terminate their
+ * VE threads so that VE cores are released.
+ */
+int veo_proc_dispatch_set_scaling(veo_proc_handle *proc,
+                                  const struct veo_dispatch_scaling *conf)
+{
+  try {
+    ProcHandleFromC(proc)->getDispatcher()->setScaling(conf);
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "failed to set scaling: %s", e.what());
+    errno = e.err();
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Allocate a VE memory buffer
+ *
+ * @param h VEO process handle
+ * @param addr [out] VEMVA address
+ * @param size [in] size in bytes
+ * @retval 0 memory allocation succeeded.
+ * @retval -1 memory allocation failed.
+ * @retval -2 internal error.
+ */
+int veo_alloc_mem(veo_proc_handle *h, uint64_t *addr, const size_t size)
+{
+  try {
+    *addr = ProcHandleFromC(h)->allocBuff(size);
+    if (*addr == 0UL)
+      return -1;
+  } catch (VEOException &e) {
+    return -2;
+  }
+  return 0;
+}
+
+/**
+ * @brief Free a VE memory buffer
+ *
+ * @param h VEO process handle
+ * @param addr [in] VEMVA address
+ * @retval 0 memory is successfully freed.
+ * @retval -1 internal error.
+ *
+ * Memory allocated by veo_alloc_mem() must be freed by veo_free_mem(),
+ * not by free() on VE: unless the VE memory arena is disabled by
+ * VEO_MEM_ARENA=0, it is not allocated by malloc() on VE. Memory
+ * allocated by malloc() on VE may be freed by veo_free_mem().
  */
 int veo_free_mem(veo_proc_handle *h, uint64_t addr)
 {
@@ -382,6 +1131,28 @@ int veo_free_mem(veo_proc_handle *h, uint64_t addr)
   return 0;
 }
 
+/**
+ * @brief get usage of the VE memory arena of a process
+ *
+ * @param h VEO process handle
+ * @param[out] stats usage of the arena
+ * @retval 0 success
+ * @retval -1 the arena is disabled by VEO_MEM_ARENA=0.
+ *
+ * veo_alloc_mem() serves buffers up to 256 KiB from regions of VE memory
+ * allocated in advance, managed on VH.
+ */
+int veo_proc_get_mem_stats(veo_proc_handle *h, struct veo_mem_stats *stats)
+{
+  try {
+    ProcHandleFromC(h)->getMemStats(stats);
+  } catch (VEOException &e) {
+    errno = e.err();
+    return -1;
+  }
+  return 0;
+}
+
 /**
  * @brief Read VE memory
  *
@@ -419,6 +1190,179 @@ int veo_write_mem(veo_proc_handle *h, uint64_t dst, const void *src,
   }
 }
 
+/**
+ * @brief register host memory for transfers
+ *
+ * @param h VEO process handle
+ * @param ptr start of host memory
+ * @param len length of host memory in byte
+ * @retval 0 the memory is registered.
+ * @retval -1 failed to lock the memory or the memory overlaps memory
+ *         already registered.
+ *
+ * The pages of registered memory are locked, so that they are never
+ * swapped out; transfers from or to the memory take the same path as the
+ * others. Registrations are kept until unregistered, veo_proc_destroy()
+ * or the process is released to a pool. With VEO_BOUNCE_SIZE set
+ * (disabled by default), small transfers of memory not registered are
+ * staged through locked bounce buffers of that size.
+ */
+int veo_register_host_mem(veo_proc_handle *h, void *ptr, size_t len)
+{
+  try {
+    ProcHandleFromC(h)->hostMem().registerMem(ptr, len);
+  } catch (VEOException &e) {
+    VEO_ERROR(nullptr, "failed to register host memory: %s", e.what());
+    errno = e.err();
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief unregister host memory
+ *
+ * @param h VEO process handle
+ * @param ptr start of host memory registered
+ * @retval 0 the memory is unregistered.
+ * @retval -1 the memory is not registered.
+ */
+int veo_unregister_host_mem(veo_proc_handle *h, void *ptr)
+{
+  try {
+    ProcHandleFromC(h)->hostMem().unregisterMem(ptr);
+  } catch (VEOException &e) {
+    errno = e.err();
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Write VE memory from a host I/O vector to a VE I/O vector
+ *
+ * @param h VEO process handle
+ * @param src host I/O vector
+ * @param srccnt the number of elements of src
+ * @param dst VE I/O vector
+ * @param dstcnt the number of elements of dst
+ * @retval 0 memory is successfully written.
+ * @retval -1 internal error, or total lengths of the vectors differ.
+ *
+ * Data gathered from src are scattered to dst in order. Small elements of
+ * dst contiguous on VE are written by one DMA; elements with a gap
+ * between them on VE are written by one DMA each.
+ */
+int veo_write_mem_iov(veo_proc_handle *h, const struct iovec *src, int srccnt,
+                      const struct veo_iovec *dst, int dstcnt)
+{
+  try {
+    return ProcHandleFromC(h)->transferIov(src, srccnt, dst, dstcnt, false);
+  } catch (VEOException &e) {
+    errno = e.err();
+    return -1;
+  }
+}
+
+/**
+ * @brief Read VE memory from a VE I/O vector to a host I/O vector
+ *
+ * @param h VEO process handle
+ * @param dst host I/O vector
+ * @param dstcnt the number of elements of dst
+ * @param src VE I/O vector
+ * @param srccnt the number of elements of src
+ * @retval 0 memory is successfully read.
+ * @retval -1 internal error, or total lengths of the vectors differ.
+ */
+int veo_read_mem_iov(veo_proc_handle *h, const struct iovec *dst, int dstcnt,
+                     const struct veo_iovec *src, int srccnt)
+{
+  try {
+    return ProcHandleFromC(h)->transferIov(dst, dstcnt, src, srccnt, true);
+  } catch (VEOException &e) {
+    errno = e.err();
+    return -1;
+  }
+}
+
+/**
+ * @brief Write a 2D block to VE memory
+ *
+ * @param h VEO process handle
+ * @param dst VEMVA of the first row
+ * @param dpitch distance between rows on VE in byte
+ * @param src VHVA of the first row
+ * @param spitch distance between rows on VH in byte
+ * @param width width of a row in byte
+ * @param height the number of rows
+ * @retval 0 memory is successfully written.
+ * @retval -1 internal error.
+ *
+ * Rows are written by one DMA each unless dpitch equals width.
+ */
+int veo_write_mem_2d(veo_proc_handle *h, uint64_t dst, size_t dpitch,
+                     const void *src, size_t spitch, size_t width,
+                     size_t height)
+{
+  try {
+    return ProcHandleFromC(h)->transfer2D(const_cast<void *>(src), spitch,
+                                          dst, dpitch, width, height, false);
+  } catch (VEOException &e) {
+    errno = e.err();
+    return -1;
+  }
+}
+
+/**
+ * @brief Read a 2D block from VE memory
+ *
+ * @param h VEO process handle
+ * @param dst VHVA of the first row
+ * @param dpitch distance between rows on VH in byte
+ * @param src VEMVA of the first row
+ * @param spitch distance between rows on VE in byte
+ * @param width width of a row in byte
+ * @param height the number of rows
+ * @retval 0 memory is successfully read.
+ * @retval -1 internal error.
+ */
+int veo_read_mem_2d(veo_proc_handle *h, void *dst, size_t dpitch,
+                    uint64_t src, size_t spitch, size_t width, size_t height)
+{
+  try {
+    return ProcHandleFromC(h)->transfer2D(dst, dpitch, src, spitch, width,
+                                          height, true);
+  } catch (VEOException &e) {
+    errno = e.err();
+    return -1;
+  }
+}
+
+/**
+ * @brief configure striped transfers of veo_read_mem() and veo_write_mem()
+ *
+ * @param h VEO process handle
+ * @param chunk_size size of a chunk in byte; a larger transfer is split
+ *        into chunks transferred in parallel.
+ * @param lanes the number of contexts transferring chunks in parallel;
+ *        zero to use all contexts serving memory operations
+ *        (VEO_MEM_WORKERS).
+ * @retval 0 success
+ * @retval -1 invalid parameters
+ */
+int veo_proc_set_transfer_striping(veo_proc_handle *h, size_t chunk_size,
+                                   int lanes)
+{
+  try {
+    ProcHandleFromC(h)->setStriping(chunk_size, lanes);
+  } catch (VEOException &e) {
+    errno = e.err();
+    return -1;
+  }
+  return 0;
+}
+
 /**
  * @brief Asynchronously read VE memory
  *
@@ -459,6 +1403,99 @@ uint64_t veo_async_write_mem(veo_thr_ctxt *ctx, uint64_t dst, const void *src,
   }
 }
 
+/**
+ * @brief Asynchronously allocate a VE memory buffer
+ *
+ * @param ctx VEO context
+ * @param size size in byte
+ * @param[out] addr_slot VEMVA of the buffer allocated
+ * @return request ID; the result is the VEMVA of the buffer.
+ * @retval VEO_REQUEST_ID_INVALID request failed.
+ *
+ * Buffers of veo_alloc_mem_async() are freed by veo_free_mem() or
+ * veo_free_mem_async(). *addr_slot is set on return unless the VE memory
+ * arena is disabled; then it is set when the request completes.
+ */
+uint64_t veo_alloc_mem_async(veo_thr_ctxt *ctx, size_t size,
+                             uint64_t *addr_slot)
+{
+  try {
+    return ThreadContextFromC(ctx)->asyncAllocMem(size, addr_slot);
+  } catch (VEOException &e) {
+    errno = e.err();
+    return VEO_REQUEST_ID_INVALID;
+  }
+}
+
+/**
+ * @brief Asynchronously free a VE memory buffer
+ *
+ * @param ctx VEO context
+ * @param addr VEMVA of the buffer
+ * @return request ID
+ * @retval VEO_REQUEST_ID_INVALID request failed.
+ *
+ * The buffer is freed after the requests on the context before,
+ * including transfers on the transfer lane of the context. Requests on
+ * other contexts using the buffer are to be waited for before.
+ */
+uint64_t veo_free_mem_async(veo_thr_ctxt *ctx, uint64_t addr)
+{
+  try {
+    return ThreadContextFromC(ctx)->asyncFreeMem(addr);
+  } catch (VEOException &e) {
+    errno = e.err();
+    return VEO_REQUEST_ID_INVALID;
+  }
+}
+
+/**
+ * @brief Asynchronously read VE memory after requests finish
+ *
+ * @param ctx VEO context
+ * @param dst destination VHVA
+ * @param src source VEMVA
+ * @param size size in byte
+ * @param deps IDs of requests on the context to finish before the transfer
+ * @param ndeps the number of IDs in deps
+ * @return request ID
+ * @retval VEO_REQUEST_ID_INVALID request failed.
+ */
+uint64_t veo_async_read_mem_dep(veo_thr_ctxt *ctx, void *dst, uint64_t src,
+                                size_t size, const uint64_t *deps, int ndeps)
+{
+  try {
+    std::vector<uint64_t> d(deps, deps + (ndeps > 0 ? ndeps : 0));
+    return ThreadContextFromC(ctx)->asyncReadMem(dst, src, size, d);
+  } catch (VEOException &e) {
+    return VEO_REQUEST_ID_INVALID;
+  }
+}
+
+/**
+ * @brief Asynchronously write VE memory after requests finish
+ *
+ * @param ctx VEO context
+ * @param dst destination VEMVA
+ * @param src source VHVA
+ * @param size size in byte
+ * @param deps IDs of requests on the context to finish before the transfer
+ * @param ndeps the number of IDs in deps
+ * @return request ID
+ * @retval VEO_REQUEST_ID_INVALID request failed.
+ */
+uint64_t veo_async_write_mem_dep(veo_thr_ctxt *ctx, uint64_t dst,
+                                 const void *src, size_t size,
+                                 const uint64_t *deps, int ndeps)
+{
+  try {
+    std::vector<uint64_t> d(deps, deps + (ndeps > 0 ? ndeps : 0));
+    return ThreadContextFromC(ctx)->asyncWriteMem(dst, src, size, d);
+  } catch (VEOException &e) {
+    return VEO_REQUEST_ID_INVALID;
+  }
+}
+
 /**
  * @brief allocate VEO arguments object (veo_args)
  *
@@ -587,6 +1624,26 @@ int veo_args_set_stack(veo_args *ca, enum veo_args_intent inout,
   }
 }
 
+/**
+ * @brief enable or disable snapshot of arguments on submission
+ *
+ * @param ca veo_args
+ * @param enable non-zero to enable
+ * @return zero upon success; negative upon failure.
+ *
+ * With snapshot enabled, a call takes a copy of the arguments, including
+ * the data of arguments on stack with VEO_INTENT_IN or VEO_INTENT_INOUT,
+ * on submission by veo_call_async() and the like. The veo_args can then
+ * be modified, reused for the next call or freed immediately.
+ * Arguments with VEO_INTENT_OUT or VEO_INTENT_INOUT are still copied out
+ * to the buffers set, which must be kept until the call finishes.
+ */
+int veo_args_set_snapshot(veo_args *ca, int enable)
+{
+  CallArgsFromC(ca)->setSnapshot(enable != 0);
+  return 0;
+}
+
 /**
  * @brief clear arguments set in VEO arguments object
  *
@@ -607,6 +1664,140 @@ void veo_args_free(veo_args *ca)
   delete CallArgsFromC(ca);
 }
 
+/**
+ * @brief prepare a call of a VE function to launch repeatedly
+ *
+ * @param ctx VEO context to execute the function on VE.
+ * @param addr VEMVA of the function to call
+ * @param signature types of arguments, a character for each:
+ *        'l' int64_t, 'L' uint64_t, 'i' int32_t, 'I' uint32_t,
+ *        'd' double and 'f' float.
+ * @return pointer to the prepared call; all arguments are zero.
+ * @retval NULL the preparation failed.
+ */
+veo_prepared_call *veo_prepare_call(veo_thr_ctxt *ctx, uint64_t addr,
+                                    const char *signature)
+{
+  try {
+    auto rv = new veo::PreparedCall(ThreadContextFromC(ctx), addr, signature);
+    return rv->toCHandle();
+  } catch (VEOException &e) {
+    errno = e.err();
+    return NULL;
+  }
+}
+
+/**
+ * @brief set a 64-bit integer argument of a prepared call
+ *
+ * @param pc prepared call
+ * @param argnum the argnum-th argument, 'l' or 'L' in the signature
+ * @param val value to be set
+ * @return zero upon success; negative upon failure.
+ */
+int veo_prepared_set_i64(veo_prepared_call *pc, int argnum, int64_t val)
+{
+  return veo_prepared_set_(pc, argnum, &veo::PreparedCall::setI64, val);
+}
+
+/**
+ * @brief set a 64-bit unsigned integer argument of a prepared call
+ *
+ * @param pc prepared call
+ * @param argnum the argnum-th argument, 'l' or 'L' in the signature
+ * @param val value to be set
+ * @return zero upon success; negative upon failure.
+ */
+int veo_prepared_set_u64(veo_prepared_call *pc, int argnum, uint64_t val)
+{
+  return veo_prepared_set_(pc, argnum, &veo::PreparedCall::setU64, val);
+}
+
+/**
+ * @brief set a 32-bit integer argument of a prepared call
+ *
+ * @param pc prepared call
+ * @param argnum the argnum-th argument, 'i' or 'I' in the signature
+ * @param val value to be set
+ * @return zero upon success; negative upon failure.
+ */
+int veo_prepared_set_i32(veo_prepared_call *pc, int argnum, int32_t val)
+{
+  return veo_prepared_set_(pc, argnum, &veo::PreparedCall::setI32, val);
+}
+
+/**
+ * @brief set a 32-bit unsigned integer argument of a prepared call
+ *
+ * @param pc prepared call
+ * @param argnum the argnum-th argument, 'i' or 'I' in the signature
+ * @param val value to be set
+ * @return zero upon success; negative upon failure.
+ */
+int veo_prepared_set_u32(veo_prepared_call *pc, int argnum, uint32_t val)
+{
+  return veo_prepared_set_(pc, argnum, &veo::PreparedCall::setU32, val);
+}
+
+/**
+ * @brief set a double argument of a prepared call
+ *
+ * @param pc prepared call
+ * @param argnum the argnum-th argument, 'd' in the signature
+ * @param val value to be set
+ * @return zero upon success; negative upon failure.
+ */
+int veo_prepared_set_double(veo_prepared_call *pc, int argnum, double val)
+{
+  return veo_prepared_set_(pc, argnum, &veo::PreparedCall::setDouble, val);
+}
+
+/**
+ * @brief set a float argument of a prepared call
+ *
+ * @param pc prepared call
+ * @param argnum the argnum-th argument, 'f' in the signature
+ * @param val value to be set
+ * @return zero upon success; negative upon failure.
+ */
+int veo_prepared_set_float(veo_prepared_call *pc, int argnum, float val)
+{
+  return veo_prepared_set_(pc, argnum, &veo::PreparedCall::setFloat, val);
+}
+
+/**
+ * @brief launch a prepared call
+ *
+ * @param pc prepared call
+ * @return request ID on the context of the call; wait for the result by
+ *         veo_call_wait_result().
+ * @retval VEO_REQUEST_ID_INVALID request failed.
+ *
+ * The arguments are copied on launch; they can be set for the next
+ * launch without waiting for the result.
+ */
+uint64_t veo_prepared_launch(veo_prepared_call *pc)
+{
+  try {
+    return PreparedCallFromC(pc)->launch();
+  } catch (VEOException &e) {
+    errno = e.err();
+    return VEO_REQUEST_ID_INVALID;
+  }
+}
+
+/**
+ * @brief free a prepared call
+ *
+ * @param pc prepared call
+ *
+ * Calls launched already are not affected.
+ */
+void veo_prepared_free(veo_prepared_call *pc)
+{
+  delete PreparedCallFromC(pc);
+}
+
 /**
  * @brief VEO version
  *
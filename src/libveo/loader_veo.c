@@ -30,6 +30,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <pthread.h>
 #include <sys/socket.h>
 #include "libved.h"
 #include "syscall.h"
@@ -275,7 +276,7 @@ int pse_load_binary(char *filename, veos_handle *handle,
 	if (0 > ret) goto err_ret;
 	fill_ve_vh_segmap(handle);
 	auxv.e_base = (Elf64_Addr)load_elf.ve_interp_map;
-	static int count = 0;
+	int count = 0;
 	struct ve_vh_segmap *seg_addr = NULL;
 	for (segnum = 0; segnum < load_elf.loadable_segnum; segnum++) {
 		seg_addr = load_elf.seg + segnum;
@@ -988,6 +989,133 @@ end:
 	return buf;
 }
 
+/**
+* @brief image of a VE ELF file cached in VH memory.
+*
+* ELF files are opened, checked and mapped once per host process; the
+* veorun binary and the dynamic linker are loaded without file I/O on
+* the creation of the second and later VE processes.
+*/
+struct ve_elf_cache {
+	char *name;	/*!< file name requested */
+	struct stat sb;	/*!< status of the file when it was cached */
+	int fd;		/*!< file descriptor kept open */
+	char *image;	/*!< read-only mapping of the whole file */
+	size_t size;	/*!< size of the file */
+	struct ve_elf_cache *next;
+};
+static struct ve_elf_cache *elf_cache_list;
+static pthread_mutex_t elf_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+* @brief check if a cached file has not been changed.
+*
+* @param[in] ent cache entry
+* @param[in] sb current status of the file
+*
+* @return 1 if the file is same as the cached one, 0 otherwise.
+*/
+static int elf_cache_valid(const struct ve_elf_cache *ent,
+		const struct stat *sb)
+{
+	return ent->sb.st_dev == sb->st_dev && ent->sb.st_ino == sb->st_ino &&
+		ent->sb.st_size == sb->st_size &&
+		ent->sb.st_mtim.tv_sec == sb->st_mtim.tv_sec &&
+		ent->sb.st_mtim.tv_nsec == sb->st_mtim.tv_nsec &&
+		ent->sb.st_ctim.tv_sec == sb->st_ctim.tv_sec &&
+		ent->sb.st_ctim.tv_nsec == sb->st_ctim.tv_nsec;
+}
+
+/**
+* @brief check if a range is within a cached file.
+*
+* @return 1 if the range is within the file, 0 otherwise.
+*/
+static int elf_cache_in_range(const struct ve_elf_cache *ent,
+		uint64_t offset, uint64_t len)
+{
+	return offset <= ent->size && len <= ent->size - offset;
+}
+
+/**
+* @brief look up an ELF file in the cache.
+*
+* @param[in] filename ELF file name.
+*
+* @return On success returns the cache entry and on failure return NULL.
+*
+* The file is opened, checked and mapped when it is not cached or it
+* has been changed since it was cached. The caller must hold
+* elf_cache_lock while the entry is used.
+*/
+static struct ve_elf_cache *elf_cache_lookup(char *filename)
+{
+	struct ve_elf_cache *ent = NULL;
+	struct stat sb = {0};
+	char *buf = NULL;
+	void *image = NULL;
+	int fd = -1;
+	int ret = 0;
+
+	if (stat(filename, &sb) == 0) {
+		for (ent = elf_cache_list; ent != NULL; ent = ent->next) {
+			if (strcmp(ent->name, filename) == 0)
+				break;
+		}
+		if (ent != NULL && elf_cache_valid(ent, &sb)) {
+			PSEUDO_DEBUG("ELF cache hit: %s", filename);
+			return ent;
+		}
+	}
+	PSEUDO_DEBUG("ELF cache miss: %s", filename);
+	buf = open_bin_file(filename, &fd);
+	if (!buf) {
+		ret = -errno;
+		goto err_ret;
+	}
+	free(buf);
+	if (0 > fstat(fd, &sb)) {
+		ret = -errno;
+		goto err_ret1;
+	}
+	if (sb.st_size < sizeof(Elf64_Ehdr)) {
+		ret = -ENOEXEC;
+		goto err_ret1;
+	}
+	image = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (MAP_FAILED == image) {
+		ret = -errno;
+		PSEUDO_ERROR("Failed(%s) to map ELF file", strerror(-ret));
+		goto err_ret1;
+	}
+	if (ent == NULL) {
+		ent = (struct ve_elf_cache *)calloc(1, sizeof(*ent));
+		if (ent == NULL || (ent->name = strdup(filename)) == NULL) {
+			ret = -ENOMEM;
+			free(ent);
+			munmap(image, sb.st_size);
+			goto err_ret1;
+		}
+		ent->next = elf_cache_list;
+		elf_cache_list = ent;
+	} else {
+		/* the file has been changed. */
+		munmap(ent->image, ent->size);
+		close(ent->fd);
+	}
+	ent->sb = sb;
+	ent->fd = fd;
+	ent->image = (char *)image;
+	ent->size = sb.st_size;
+	return ent;
+
+err_ret1:
+	close(fd);
+err_ret:
+	errno = -ret;
+	return NULL;
+}
+
 /**
 * @brief Read ELF file in VH memory space.
 *
@@ -998,7 +1126,7 @@ end:
 */
 char *vh_map_elf_dyn(char *filename)
 {
-	char *buf = NULL;
+	struct ve_elf_cache *ent = NULL;
 	char *head = NULL;
 	int fd = -1;
 	int ret = 0;
@@ -1007,56 +1135,38 @@ char *vh_map_elf_dyn(char *filename)
 	Elf64_Shdr *nhdr = NULL;
 
 	PSEUDO_DEBUG("INTERP: %s", load_elf.stat.file_interp);
-	buf = open_bin_file(filename, &fd);
-	if (!buf) {
+	pthread_mutex_lock(&elf_cache_lock);
+	ent = elf_cache_lookup(filename);
+	if (!ent) {
 		ret = -errno;
 		goto err_ret;
 	}
-	ehdr = (Elf64_Ehdr *)buf;
+	ehdr = (Elf64_Ehdr *)ent->image;
 	map_size = ehdr->e_ehsize + (ehdr->e_phentsize * ehdr->e_phnum);
-
-	if (0 > (lseek(fd, 0, SEEK_SET))) {
-		ret = -errno;
-		close(fd);
-		PSEUDO_ERROR("Failed(%s) to repositions file offset: dynamic",
-				strerror(-ret));
-		goto err_ret1;
-	}
-	if (buf)
-		free(buf);
-
-	buf = (char *)calloc(1, map_size);
-	if(!buf) {
-		ret = -errno;
-		close(fd);
-		PSEUDO_ERROR("Failed(%s) to create buffer: "
-				"dynamic", strerror(-ret));
+	if (!elf_cache_in_range(ent, 0, map_size) ||
+	    !elf_cache_in_range(ent, ehdr->e_shoff,
+			(uint64_t)ehdr->e_shentsize * ehdr->e_shnum) ||
+	    ehdr->e_shstrndx >= ehdr->e_shnum) {
+		ret = -ENOEXEC;
+		PSEUDO_ERROR("Invalid ELF headers: dynamic");
 		goto err_ret;
 	}
-
-	if (0 > (read(fd, buf, map_size))) {
+	/* The descriptor is closed after loading. */
+	fd = fcntl(ent->fd, F_DUPFD_CLOEXEC, 0);
+	if (0 > fd) {
 		ret = -errno;
-		close(fd);
-		PSEUDO_ERROR("Failed(%s) to read data: dynamic",
+		PSEUDO_ERROR("Failed(%s) to duplicate fd: dynamic",
 				strerror(-ret));
-		goto err_ret1;
+		goto err_ret;
 	}
 
-	(void)memcpy(load_elf.stat.file_interp_end, buf, map_size);
+	(void)memcpy(load_elf.stat.file_interp_end, ent->image, map_size);
 	/* Saving fd  for reference */
 	load_elf.stat.fd_dyn = fd;
 
 	PSEUDO_DEBUG("INTERP_START: %p",
 			(void *)load_elf.stat.file_interp_end);
 
-	ehdr = (Elf64_Ehdr *)buf;
-	if (0 > (lseek(fd, ehdr->e_shoff, SEEK_SET))) {
-		ret = -errno;
-		close(fd);
-		PSEUDO_ERROR("Failed(%s) to repositions file offset: dynamic",
-				strerror(-ret));
-		goto err_ret1;
-	}
 	map_size = ((ehdr->e_shentsize) * (ehdr->e_shnum));
 	load_elf.stat.start_section_dyn = (char *)calloc(1,
 			map_size);
@@ -1065,30 +1175,22 @@ char *vh_map_elf_dyn(char *filename)
 		close(fd);
 		PSEUDO_ERROR("Failed(%s) to allocated buffer to read start"
 				" section: dynamic", strerror(-ret));
-		goto err_ret1;
-	}
-	if (0 > (read(fd, load_elf.stat.start_section_dyn, map_size))) {
-		ret = -errno;
-		close(fd);
-		PSEUDO_ERROR("Failed(%s) to read start section: dynamic",
-				strerror(-ret));
-		free(load_elf.stat.start_section_dyn);
-		goto err_ret1;
+		goto err_ret;
 	}
+	(void)memcpy(load_elf.stat.start_section_dyn,
+			ent->image + ehdr->e_shoff, map_size);
 
 	nhdr = (Elf64_Shdr *)load_elf.stat.start_section_dyn;
 	nhdr += ehdr->e_shstrndx;
 	PSEUDO_DEBUG("Section: offset %p, size: %p",
 			(void *)nhdr->sh_offset,
 			(void *)nhdr->sh_size);
-
-	if (0 > (lseek(fd, nhdr->sh_offset, SEEK_SET))) {
-		ret = -errno;
+	if (!elf_cache_in_range(ent, nhdr->sh_offset, nhdr->sh_size)) {
+		ret = -ENOEXEC;
 		close(fd);
-		PSEUDO_ERROR("Failed(%s) to repositions file offset: dynamic",
-				strerror(-ret));
+		PSEUDO_ERROR("Invalid section header string table: dynamic");
 		free(load_elf.stat.start_section_dyn);
-		goto err_ret1;
+		goto err_ret;
 	}
 
 	load_elf.stat.start_string_dyn = (char *)calloc(1, nhdr->sh_size);
@@ -1098,23 +1200,14 @@ char *vh_map_elf_dyn(char *filename)
 		PSEUDO_ERROR("Failed(%s) to allocated buffer to read start"
 				" string: dynamic", strerror(-ret));
 		free(load_elf.stat.start_section_dyn);
-		goto err_ret1;
-	}
-
-	if (0 > (read(fd, load_elf.stat.start_string_dyn, nhdr->sh_size))) {
-		ret = -errno;
-		close(fd);
-		PSEUDO_ERROR("Failed(%s) to read start string: dynamic",
-				strerror(-ret));
-		free(load_elf.stat.start_section_dyn);
-		free(load_elf.stat.start_string_dyn);
-		goto err_ret1;
+		goto err_ret;
 	}
+	(void)memcpy(load_elf.stat.start_string_dyn,
+			ent->image + nhdr->sh_offset, nhdr->sh_size);
 	head = load_elf.stat.file_interp_end;
 
-err_ret1:
-	free(buf);
 err_ret:
+	pthread_mutex_unlock(&elf_cache_lock);
 	errno = -ret;
 	return head;
 }
@@ -1129,7 +1222,7 @@ err_ret:
 */
 void *vh_map_elf(char *filename)
 {
-	char *buf = NULL;
+	struct ve_elf_cache *ent = NULL;
 	int fd = -1;
 	int ret = 0;
 	int map_size = -1;
@@ -1139,15 +1232,34 @@ void *vh_map_elf(char *filename)
 	Elf64_Ehdr *ehdr = NULL;
 	Elf64_Shdr *nhdr = NULL;
 
-	buf = open_bin_file(filename, &fd);
-	if (!buf) {
+	pthread_mutex_lock(&elf_cache_lock);
+	ent = elf_cache_lookup(filename);
+	if (!ent) {
 		ret = -errno;
 		goto err_ret;
 	}
-	ehdr = (Elf64_Ehdr *)buf;
-
+	ehdr = (Elf64_Ehdr *)ent->image;
 	map_size = ehdr->e_ehsize + (ehdr->e_phentsize * ehdr->e_phnum);
+	size = ((ehdr->e_shentsize) * (ehdr->e_shnum));
+	if (!elf_cache_in_range(ent, 0, map_size) ||
+	    !elf_cache_in_range(ent, ehdr->e_shoff, size) ||
+	    ehdr->e_shstrndx >= ehdr->e_shnum) {
+		ret = -ENOEXEC;
+		PSEUDO_ERROR("Invalid ELF headers");
+		goto err_ret;
+	}
+	/* The descriptor is closed after loading. */
+	fd = fcntl(ent->fd, F_DUPFD_CLOEXEC, 0);
+	if (0 > fd) {
+		ret = -errno;
+		PSEUDO_ERROR("Failed(%s) to duplicate fd", strerror(-ret));
+		goto err_ret;
+	}
 
+	/*
+	 * The headers of the dynamic linker are copied after the headers,
+	 * so the private writable mapping is used.
+	 */
 	map_addr = mmap(NULL, map_size,
 			PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
 	if (MAP_FAILED == map_addr) {
@@ -1155,7 +1267,7 @@ void *vh_map_elf(char *filename)
 		close(fd);
 		PSEUDO_ERROR("Failed(%s) to create virtual address space"
 				" mapping", strerror(-ret));
-		goto err_ret1;
+		goto err_ret;
 	}
 	PSEUDO_DEBUG("For mapping the ELF file: %s, Map address: %p",
 			filename, (void *)map_addr);
@@ -1164,15 +1276,6 @@ void *vh_map_elf(char *filename)
 	load_elf.stat.file_interp = map_addr + map_size;
 	load_elf.stat.fd = fd;
 
-	if (0 > (lseek(fd, ehdr->e_shoff, SEEK_SET))) {
-		ret = -errno;
-		close(fd);
-		PSEUDO_ERROR("Failed(%s) to reposition file offset",
-				strerror(-ret));
-		munmap(map_addr, map_size);
-		goto err_ret1;
-	}
-	size = ((ehdr->e_shentsize) * (ehdr->e_shnum));
 	load_elf.stat.start_section = (char *)calloc(1,
 			size);
 	if(!load_elf.stat.start_section) {
@@ -1181,32 +1284,23 @@ void *vh_map_elf(char *filename)
 		PSEUDO_ERROR("Failed(%s) to create buffer to read start"
 				" section", strerror(-ret));
 		munmap(map_addr, map_size);
-		goto err_ret1;
-	}
-	if (0 > (read(fd, load_elf.stat.start_section, size))) {
-		ret = -errno;
-		close(fd);
-		PSEUDO_ERROR("Failed(%s) to read start section",
-				strerror(-ret));
-		munmap(map_addr, map_size);
-		free(load_elf.stat.start_section);
-		goto err_ret1;
+		goto err_ret;
 	}
+	(void)memcpy(load_elf.stat.start_section,
+			ent->image + ehdr->e_shoff, size);
 
 	nhdr = (Elf64_Shdr *)load_elf.stat.start_section;
 	nhdr += ehdr->e_shstrndx;
 	PSEUDO_DEBUG("Section: offset %p, size: %p",
 			(void *)nhdr->sh_offset,
 			(void *)nhdr->sh_size);
-
-	if (0 > (lseek(fd, nhdr->sh_offset, SEEK_SET))) {
-		ret = -errno;
+	if (!elf_cache_in_range(ent, nhdr->sh_offset, nhdr->sh_size)) {
+		ret = -ENOEXEC;
 		close(fd);
-		PSEUDO_ERROR("Failed(%s) to reposition file offset",
-				strerror(-ret));
+		PSEUDO_ERROR("Invalid section header string table");
 		munmap(map_addr, map_size);
 		free(load_elf.stat.start_section);
-		goto err_ret1;
+		goto err_ret;
 	}
 
 	load_elf.stat.start_string = (char *)calloc(1, nhdr->sh_size);
@@ -1217,22 +1311,14 @@ void *vh_map_elf(char *filename)
 				" string", strerror(-ret));
 		munmap(map_addr, map_size);
 		free(load_elf.stat.start_section);
-		goto err_ret1;
-	}
-	if (0 > (read(fd, load_elf.stat.start_string, nhdr->sh_size))) {
-		ret = -errno;
-		close(fd);
-		PSEUDO_ERROR("Failed(%s) to read start string", strerror(-ret));
-		munmap(map_addr, map_size);
-		free(load_elf.stat.start_section);
-		free(load_elf.stat.start_string);
-		goto err_ret1;
+		goto err_ret;
 	}
+	(void)memcpy(load_elf.stat.start_string,
+			ent->image + nhdr->sh_offset, nhdr->sh_size);
 	head = map_addr;
 
-err_ret1:
-	free(buf);
 err_ret:
+	pthread_mutex_unlock(&elf_cache_lock);
 	errno = -ret;
 	return head;
 }
@@ -4,6 +4,9 @@
  */
 #include <pthread.h>
 #include <signal.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 #include "handle.h"
 #include "comm_request.h"
 #include "sys_process_mgmt.h"
@@ -19,3 +22,188 @@ struct ve_address_space_info ve_info;
 uint64_t default_page_size;
 struct ve_load_data load_elf;
 struct vemva_header vemva_header;
+
+/**
+ * @brief state of a VE process held in the global variables above
+ *
+ * libvepseudo refers to the global variables directly by symbol, so they
+ * cannot be replaced with pointers to per-process objects. libveo keeps
+ * a copy of the data for each VE process and switches the global
+ * variables to the VE process to be handled. Locks and condition
+ * variables in them are never copied; they stay in the global variables,
+ * shared by all VE processes, and are used only while the global
+ * variables are switched to a VE process.
+ */
+struct veo_proc_state {
+	struct tid_info global_tid_info[VEOS_MAX_VE_THREADS];
+	int nthreads;/* slots of global_tid_info up to the last in use */
+	__typeof__(tid_counter) tid_counter;
+	struct ve_address_space_info ve_info;
+	uint64_t default_page_size;
+	struct ve_load_data load_elf;
+	struct vemva_header vemva_header;
+};
+
+/**
+ * @brief a region in a structure
+ */
+struct region {
+	size_t offset;
+	size_t size;
+};
+
+/**
+ * @brief copy a structure except regions
+ *
+ * @param[out] dst destination
+ * @param src source
+ * @param size size of the structure
+ * @param skip regions not copied, sorted by offset
+ * @param n the number of regions
+ */
+static void copy_except(void *dst, const void *src, size_t size,
+			const struct region *skip, int n)
+{
+	size_t pos = 0;
+	for (int i = 0; i < n; ++i) {
+		memcpy((char *)dst + pos, (const char *)src + pos,
+			skip[i].offset - pos);
+		pos = skip[i].offset + skip[i].size;
+	}
+	memcpy((char *)dst + pos, (const char *)src + pos, size - pos);
+}
+
+#define REGION(type, member) \
+	{ offsetof(type, member), sizeof(((type *)0)->member) }
+
+/**
+ * @brief copy thread information without its mutex and condition variable
+ *
+ * @param[out] dst destination
+ * @param src source; NULL to clear dst.
+ * @param n the number of slots
+ */
+static void copy_tid_info(struct tid_info *dst, const struct tid_info *src,
+			  int n)
+{
+	static const struct tid_info unused;
+	struct region skip[2] = {
+		REGION(struct tid_info, mutex),
+		REGION(struct tid_info, cond),
+	};
+	if (skip[0].offset > skip[1].offset) {
+		struct region tmp = skip[0];
+		skip[0] = skip[1];
+		skip[1] = tmp;
+	}
+	for (int i = 0; i < n; ++i)
+		copy_except(&dst[i], src != NULL ? &src[i] : &unused,
+			sizeof(dst[i]), skip, 2);
+}
+
+/**
+ * @brief the number of slots of thread information up to the last in use
+ *
+ * Only these slots are copied on a switch; a VE process usually has far
+ * fewer threads than VEOS_MAX_VE_THREADS.
+ */
+static int count_tid_info(const struct tid_info *info)
+{
+	int n = VEOS_MAX_VE_THREADS;
+	while (n > 0 && info[n - 1].tid_val == 0)
+		--n;
+	return n;
+}
+
+/**
+ * @brief copy VEMVA header without its lock
+ */
+static void copy_vemva_header(struct vemva_header *dst,
+			      const struct vemva_header *src)
+{
+	struct region skip[1] = {
+		REGION(struct vemva_header, vemva_lock),
+	};
+	copy_except(dst, src, sizeof(*dst), skip, 1);
+}
+
+/**
+ * @brief move a list head keeping the list linked
+ *
+ * @param[out] dst a new list head
+ * @param src the current list head
+ */
+static void move_list_head(struct list_head *dst, struct list_head *src)
+{
+	if (src->next == NULL || src->next == src) {
+		INIT_LIST_HEAD(dst);
+		return;
+	}
+	dst->next = src->next;
+	dst->prev = src->prev;
+	dst->next->prev = dst;
+	dst->prev->next = dst;
+}
+
+static pthread_once_t locks_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief initialize locks in the global thread information once
+ */
+static void init_locks(void)
+{
+	for (int i = 0; i < VEOS_MAX_VE_THREADS; ++i) {
+		pthread_mutex_init(&global_tid_info[i].mutex, NULL);
+		pthread_cond_init(&global_tid_info[i].cond, NULL);
+	}
+}
+
+/**
+ * @brief allocate the state of a new VE process
+ *
+ * @return pointer to the state; NULL upon failure.
+ */
+struct veo_proc_state *veo_proc_state_alloc(void)
+{
+	pthread_once(&locks_once, init_locks);
+	struct veo_proc_state *state = calloc(1, sizeof(*state));
+	if (state == NULL)
+		return NULL;
+	INIT_LIST_HEAD(&state->vemva_header.vemva_list);
+	return state;
+}
+
+/**
+ * @brief save the global variables to the state of a VE process
+ */
+void veo_proc_state_save(struct veo_proc_state *state)
+{
+	state->nthreads = count_tid_info(global_tid_info);
+	copy_tid_info(state->global_tid_info, global_tid_info, state->nthreads);
+	state->tid_counter = tid_counter;
+	state->ve_info = ve_info;
+	state->default_page_size = default_page_size;
+	state->load_elf = load_elf;
+	copy_vemva_header(&state->vemva_header, &vemva_header);
+	move_list_head(&state->vemva_header.vemva_list,
+		&vemva_header.vemva_list);
+}
+
+/**
+ * @brief load the state of a VE process to the global variables
+ */
+void veo_proc_state_load(struct veo_proc_state *state)
+{
+	int used = count_tid_info(global_tid_info);
+	copy_tid_info(global_tid_info, state->global_tid_info, state->nthreads);
+	if (used > state->nthreads)
+		copy_tid_info(&global_tid_info[state->nthreads], NULL,
+			used - state->nthreads);
+	tid_counter = state->tid_counter;
+	ve_info = state->ve_info;
+	default_page_size = state->default_page_size;
+	load_elf = state->load_elf;
+	copy_vemva_header(&vemva_header, &state->vemva_header);
+	move_list_head(&vemva_header.vemva_list,
+		&state->vemva_header.vemva_list);
+}